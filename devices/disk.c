@@ -48,6 +48,10 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors one READ or WRITE SECTOR command can transfer.
+   The Sector Count register is 8 bits wide; 0 stands for 256. */
+#define MAX_XFER_SECTORS 256
+
 /* An ATA device. */
 struct disk {
 	char name[8];               /* Name, e.g. "hd0:1". */
@@ -84,7 +88,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -231,39 +235,7 @@ disk_size (struct disk *d) {
    디스크 접근은 내부적으로 동기화되므로, 외부에서 디스크별 잠금을 할 필요가 없습니다. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-    struct channel *c;
-
-    // 디스크와 버퍼가 NULL이 아닌지 확인합니다.
-    ASSERT (d != NULL);
-    ASSERT (buffer != NULL);
-
-    // 디스크의 채널을 가져옵니다.
-    c = d->channel;
-
-    // 채널의 잠금을 획득합니다.
-    lock_acquire (&c->lock);
-
-    // 읽을 섹터를 선택합니다.
-    select_sector (d, sec_no);
-
-    // 읽기 명령을 실행합니다.
-    issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-
-    // 명령이 완료될 때까지 대기합니다.
-    sema_down (&c->completion_wait);
-
-    // 디스크가 여전히 바쁜 상태인지 확인하고, 문제가 발생하면 패닉을 발생시킵니다.
-    if (!wait_while_busy (d))
-        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-
-    // 섹터 데이터를 버퍼에 입력합니다.
-    input_sector (c, buffer);
-
-    // 읽기 카운트를 증가시킵니다.
-    d->read_cnt++;
-
-    // 채널의 잠금을 해제합니다.
-    lock_release (&c->lock);
+    disk_readv (d, sec_no, &buffer, 1, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -277,38 +249,88 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    디스크 접근은 내부적으로 동기화되므로, 외부에서 디스크별 잠금을 할 필요가 없습니다. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+    disk_writev (d, sec_no, &buffer, 1, 1);
+}
+
+/* Reads BUF_CNT * PER_BUF consecutive sectors, starting at
+   SEC_NO, from disk D: the first PER_BUF sectors into BUFS[0],
+   the next PER_BUF into BUFS[1], and so on.  Each buffer must
+   have room for PER_BUF * DISK_SECTOR_SIZE bytes.
+   The sectors are moved with as few multi-sector commands as
+   the device allows, rather than with one command per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_readv (struct disk *d, disk_sector_t sec_no, void *const bufs[],
+		size_t buf_cnt, size_t per_buf) {
+    size_t total = buf_cnt * per_buf;
     struct channel *c;
+    size_t i, end;
 
-    // 디스크와 버퍼가 NULL이 아닌지 확인합니다.
     ASSERT (d != NULL);
-    ASSERT (buffer != NULL);
+    ASSERT (bufs != NULL);
+    ASSERT (per_buf > 0);
 
-    // 디스크의 채널을 가져옵니다.
     c = d->channel;
-
-    // 채널의 잠금을 획득합니다.
     lock_acquire (&c->lock);
+    for (i = 0; i < total; ) {
+        size_t cnt = total - i < MAX_XFER_SECTORS ? total - i : MAX_XFER_SECTORS;
+
+        select_sectors (d, sec_no + i, cnt);
+        issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+
+        // 섹터마다 인터럽트가 한 번씩 오고, 그 뒤에 데이터를 읽을 수 있습니다.
+        for (end = i + cnt; i < end; i++) {
+            sema_down (&c->completion_wait);
+            if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                        d->name, (disk_sector_t) (sec_no + i));
+            input_sector (c, (uint8_t *) bufs[i / per_buf]
+                    + i % per_buf * DISK_SECTOR_SIZE);
+        }
+    }
+    d->read_cnt += total;
+    lock_release (&c->lock);
+}
 
-    // 작성할 섹터를 선택합니다.
-    select_sector (d, sec_no);
-
-    // 쓰기 명령을 실행합니다.
-    issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-
-    // 디스크가 여전히 바쁜 상태인지 확인하고, 문제가 발생하면 패닉을 발생시킵니다.
-    if (!wait_while_busy (d))
-        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-
-    // 버퍼의 데이터를 섹터로 출력합니다.
-    output_sector (c, buffer);
-
-    // 명령이 완료될 때까지 대기합니다.
-    sema_down (&c->completion_wait);
+/* Writes BUF_CNT * PER_BUF consecutive sectors, starting at
+   SEC_NO, to disk D: the first PER_BUF sectors from BUFS[0], the
+   next PER_BUF from BUFS[1], and so on.  Returns after the disk
+   has acknowledged receiving all the data.
+   The sectors are moved with as few multi-sector commands as
+   the device allows, rather than with one command per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_writev (struct disk *d, disk_sector_t sec_no, const void *const bufs[],
+		size_t buf_cnt, size_t per_buf) {
+    size_t total = buf_cnt * per_buf;
+    struct channel *c;
+    size_t i, end;
 
-    // 쓰기 카운트를 증가시킵니다.
-    d->write_cnt++;
+    ASSERT (d != NULL);
+    ASSERT (bufs != NULL);
+    ASSERT (per_buf > 0);
 
-    // 채널의 잠금을 해제합니다.
+    c = d->channel;
+    lock_acquire (&c->lock);
+    for (i = 0; i < total; ) {
+        size_t cnt = total - i < MAX_XFER_SECTORS ? total - i : MAX_XFER_SECTORS;
+
+        select_sectors (d, sec_no + i, cnt);
+        issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+
+        // 섹터를 하나 보낼 때마다 디스크가 받았다는 인터럽트를 보냅니다.
+        for (end = i + cnt; i < end; i++) {
+            if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                        d->name, (disk_sector_t) (sec_no + i));
+            output_sector (c, (const uint8_t *) bufs[i / per_buf]
+                    + i % per_buf * DISK_SECTOR_SIZE);
+            sema_down (&c->completion_wait);
+        }
+    }
+    d->write_cnt += total;
     lock_release (&c->lock);
 }
 
@@ -464,17 +486,19 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers, so that the next command transfers CNT sectors
+   starting at SEC_NO.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= MAX_XFER_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == MAX_XFER_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -96,15 +96,16 @@ timer_elapsed (int64_t then) {
 /* Suspends execution for approximately TICKS timer ticks. */
 void
 timer_sleep (int64_t ticks) {				// tick (0.01 s => 10ms) 만큼 sleep 하라!
-	// int64_t start = timer_ticks ();
+	int64_t start = timer_ticks ();
 
 	ASSERT (intr_get_level () == INTR_ON);	// 인터럽트 끄지 말 것.
-	// while (timer_elapsed (start) < ticks)
-	// 	thread_yield ();
 
 	/* customed */
-	// if (timer_ticks() < ticks)
-	thread_sleep(timer_ticks() + ticks);
+	/* If the sleep heap cannot grow, fall back on yielding until
+	   the time is up rather than failing the call. */
+	if (!thread_sleep(start + ticks))
+		while (timer_elapsed (start) < ticks)
+			thread_yield ();
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -155,7 +156,9 @@ timer_interrupt (struct intr_frame *args UNUSED) {
 		}
 	}
 	
-	thread_wakeup (ticks);
+	/* Nothing to wake before the earliest deadline. */
+	if (ticks >= get_thread_ttw_tick ())
+		thread_wakeup (ticks);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -5,6 +5,7 @@
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -75,7 +76,8 @@ dir_get_inode (struct dir *dir) {
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * The caller must hold DIR's directory lock, in either mode. */
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
@@ -97,6 +99,17 @@ lookup (const struct dir *dir, const char *name,
 	return false;
 }
 
+/* Copies NAME, which may be in user memory, into KNAME so that the
+ * directory lock is never held while touching the caller's memory.
+ * Returns false if NAME is empty or longer than NAME_MAX. */
+static bool
+copy_name (char kname[NAME_MAX + 1], const char *name) {
+	if (*name == '\0' || strlen (name) > NAME_MAX)
+		return false;
+	strlcpy (kname, name, NAME_MAX + 1);
+	return true;
+}
+
 /* Searches DIR for a file with the given NAME
  * and returns true if one exists, false otherwise.
  * On success, sets *INODE to an inode for the file, otherwise to
@@ -105,14 +118,21 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
 	struct dir_entry e;
+	char kname[NAME_MAX + 1];
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
+	*inode = NULL;
+	if (!copy_name (kname, name))
+		return false;
+
+	rwlock_acquire_read (inode_dir_lock (dir->inode));
+	if (lookup (dir, kname, &e, NULL))
 		*inode = inode_open (e.inode_sector);
 	else
 		*inode = NULL;
+	rwlock_release_read (inode_dir_lock (dir->inode));
 
 	return *inode != NULL;
 }
@@ -126,6 +146,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	struct dir_entry e;
+	char kname[NAME_MAX + 1];
 	off_t ofs;
 	bool success = false;
 
@@ -133,11 +154,13 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	ASSERT (name != NULL);
 
 	/* Check NAME for validity. */
-	if (*name == '\0' || strlen (name) > NAME_MAX)
+	if (!copy_name (kname, name))
 		return false;
 
+	rwlock_acquire_write (inode_dir_lock (dir->inode));
+
 	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	if (lookup (dir, kname, NULL, NULL))
 		goto done;
 
 	/* Set OFS to offset of free slot.
@@ -154,11 +177,12 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 
 	/* Write slot. */
 	e.in_use = true;
-	strlcpy (e.name, name, sizeof e.name);
+	strlcpy (e.name, kname, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+	rwlock_release_write (inode_dir_lock (dir->inode));
 	return success;
 }
 
@@ -169,14 +193,20 @@ bool
 dir_remove (struct dir *dir, const char *name) {
 	struct dir_entry e;
 	struct inode *inode = NULL;
+	char kname[NAME_MAX + 1];
 	bool success = false;
 	off_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	if (!copy_name (kname, name))
+		return false;
+
+	rwlock_acquire_write (inode_dir_lock (dir->inode));
+
 	/* Find directory entry. */
-	if (!lookup (dir, name, &e, &ofs))
+	if (!lookup (dir, kname, &e, &ofs))
 		goto done;
 
 	/* Open inode. */
@@ -194,6 +224,7 @@ dir_remove (struct dir *dir, const char *name) {
 	success = true;
 
 done:
+	rwlock_release_write (inode_dir_lock (dir->inode));
 	inode_close (inode);
 	return success;
 }
@@ -204,13 +235,20 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	rwlock_acquire_read (inode_dir_lock (dir->inode));
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
-			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	rwlock_release_read (inode_dir_lock (dir->inode));
+
+	/* NAME may be in user memory, so copy it out unlocked. */
+	if (found)
+		strlcpy (name, e.name, NAME_MAX + 1);
+	return found;
 }
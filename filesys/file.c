@@ -1,29 +1,41 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
+	struct lock pos_lock;       /* Serializes reads and updates of POS. */
 	bool deny_write;            /* Has file_deny_write() been called? */
 };
 
+/* Cache that struct files are allocated from. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) {
+	file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) {
-	struct file *file = calloc (1, sizeof *file);
+	struct file *file = kmem_cache_alloc (file_cache);
 	if (inode != NULL && file != NULL) {
 		file->inode = inode;
 		file->pos = 0;
+		lock_init (&file->pos_lock);
 		file->deny_write = false;
 		return file;
 	} else {
 		inode_close (inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 		return NULL;
 	}
 }
@@ -41,7 +53,9 @@ struct file *
 file_duplicate (struct file *file) {
 	struct file *nfile = file_open (inode_reopen (file->inode));
 	if (nfile) {
+		lock_acquire (&file->pos_lock);
 		nfile->pos = file->pos;
+		lock_release (&file->pos_lock);
 		if (file->deny_write)
 			file_deny_write (nfile);
 	}
@@ -54,7 +68,7 @@ file_close (struct file *file) {
 	if (file != NULL) {
 		file_allow_write (file);
 		inode_close (file->inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 	}
 }
 
@@ -68,11 +82,17 @@ file_get_inode (struct file *file) {
  * starting at the file's current position.
  * Returns the number of bytes actually read,
  * which may be less than SIZE if end of file is reached.
- * Advances FILE's position by the number of bytes read. */
+ * Advances FILE's position by the number of bytes read.
+ * Page-fault handlers must use file_read_at() instead, since the
+ * position lock may be held by the faulting thread. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
-	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	off_t bytes_read;
+
+	lock_acquire (&file->pos_lock);
+	bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
+	lock_release (&file->pos_lock);
 	return bytes_read;
 }
 
@@ -95,8 +115,12 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
-	off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+	off_t bytes_written;
+
+	lock_acquire (&file->pos_lock);
+	bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
 	file->pos += bytes_written;
+	lock_release (&file->pos_lock);
 	return bytes_written;
 }
 
@@ -149,13 +173,20 @@ void
 file_seek (struct file *file, off_t new_pos) {
 	ASSERT (file != NULL);
 	ASSERT (new_pos >= 0);
+	lock_acquire (&file->pos_lock);
 	file->pos = new_pos;
+	lock_release (&file->pos_lock);
 }
 
 /* Returns the current position in FILE as a byte offset from the
  * start of the file. */
 off_t
 file_tell (struct file *file) {
+	off_t pos;
+
 	ASSERT (file != NULL);
-	return file->pos;
+	lock_acquire (&file->pos_lock);
+	pos = file->pos;
+	lock_release (&file->pos_lock);
+	return pos;
 }
@@ -6,6 +6,9 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -33,6 +36,8 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct rwlock rwlock;               /* Shared for reads, exclusive for writes. */
+	struct rwlock dir_lock;             /* Guards entries, if a directory. */
 	struct inode_disk data;             /* Inode content. */
 };
 
@@ -53,10 +58,29 @@ byte_to_sector (const struct inode *inode, off_t pos) {
  * returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and each inode's open_cnt and removed. */
+static struct lock open_inodes_lock;
+
+/* Cache that in-memory inodes are allocated from. */
+static struct kmem_cache *inode_cache;
+
+/* Constructs a cached inode.  Inodes are freed with their locks
+ * released, so the locks are initialized only once. */
+static void
+inode_ctor (void *inode_) {
+	struct inode *inode = inode_;
+
+	rwlock_init (&inode->rwlock);
+	rwlock_init (&inode->dir_lock);
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	lock_init (&open_inodes_lock);
+	inode_cache = kmem_cache_create ("inode", sizeof (struct inode),
+			inode_ctor);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -104,36 +128,46 @@ inode_open (disk_sector_t sector) {
 	struct list_elem *e;
 	struct inode *inode;
 
+	lock_acquire (&open_inodes_lock);
+
 	/* Check whether this inode is already open. */
 	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
 			e = list_next (e)) {
 		inode = list_entry (e, struct inode, elem);
 		if (inode->sector == sector) {
-			inode_reopen (inode);
+			inode->open_cnt++;
+			lock_release (&open_inodes_lock);
 			return inode; 
 		}
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	inode = kmem_cache_alloc (inode_cache);
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
-	/* Initialize. */
+	/* Initialize.  The inode is read while still holding the list
+	 * lock so that nobody finds it half-initialized. */
 	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
 	disk_read (filesys_disk, inode->sector, &inode->data);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -153,9 +187,11 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
+	lock_acquire (&open_inodes_lock);
 	if (--inode->open_cnt == 0) {
 		/* Remove from inode list and release lock. */
 		list_remove (&inode->elem);
+		lock_release (&open_inodes_lock);
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
@@ -164,8 +200,9 @@ inode_close (struct inode *inode) {
 					bytes_to_sectors (inode->data.length)); 
 		}
 
-		free (inode); 
-	}
+		kmem_cache_free (inode_cache, inode); 
+	} else
+		lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -173,45 +210,68 @@ inode_close (struct inode *inode) {
 void
 inode_remove (struct inode *inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&open_inodes_lock);
 	inode->removed = true;
+	lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
+ * than SIZE if an error occurs or end of file is reached.
+ * Any number of readers may be inside at once.
+ *
+ * BUFFER may be user memory, and a page fault while copying into it
+ * may need this inode's lock to load or evict a page of a mapping of
+ * this file.  So the lock is taken for one sector at a time, and data
+ * bound for user memory is staged in a bounce buffer and copied out
+ * after the lock is released. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
+	bool direct = is_kernel_vaddr (buffer);
 	uint8_t *bounce = NULL;
 
 	while (size > 0) {
-		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx;
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
-
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
+		int min_left, chunk_size;
+
+		/* Kernel buffers take whole sectors directly; anything else
+		 * goes through the bounce buffer. */
+		if (bounce == NULL
+				&& (!direct || sector_ofs != 0 || size < DISK_SECTOR_SIZE)) {
+			bounce = malloc (DISK_SECTOR_SIZE);
+			if (bounce == NULL)
+				break;
+		}
+
+		rwlock_acquire_read (&inode->rwlock);
+
+		/* Disk sector to read, bytes left in inode, lesser of bytes
+		 * left in inode and in sector. */
+		sector_idx = byte_to_sector (inode, offset);
+		inode_left = inode_length (inode) - offset;
+		min_left = inode_left < sector_left ? inode_left : sector_left;
 
 		/* Number of bytes to actually copy out of this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+		chunk_size = size < min_left ? size : min_left;
+		if (chunk_size <= 0) {
+			rwlock_release_read (&inode->rwlock);
 			break;
+		}
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
+		if (direct && sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+			disk_read (filesys_disk, sector_idx, buffer + bytes_read);
+			rwlock_release_read (&inode->rwlock);
 		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
+			/* Read sector into bounce buffer, then copy into
+			 * caller's buffer with the lock released. */
 			disk_read (filesys_disk, sector_idx, bounce);
+			rwlock_release_read (&inode->rwlock);
 			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
 		}
 
@@ -229,53 +289,80 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
  * Returns the number of bytes actually written, which may be
  * less than SIZE if end of file is reached or an error occurs.
  * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * growth is not yet implemented.)
+ *
+ * As in inode_read_at(), the lock is taken for one sector at a time,
+ * and data from user memory is copied into a staging buffer before
+ * the lock is taken. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
+	bool direct = is_kernel_vaddr (buffer);
 	uint8_t *bounce = NULL;
-
-	if (inode->deny_write_cnt)
-		return 0;
+	uint8_t *staged = NULL;
 
 	while (size > 0) {
-		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx;
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
-
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
+		int min_left, chunk_size;
+		const uint8_t *src;
+
+		/* Bytes this sector could take, before checking the length. */
+		chunk_size = size < sector_left ? size : sector_left;
+
+		/* We need a bounce buffer for partial sectors, and a staging
+		 * buffer for user data. */
+		if (bounce == NULL && (!direct || chunk_size < DISK_SECTOR_SIZE)) {
+			bounce = malloc (2 * DISK_SECTOR_SIZE);
+			if (bounce == NULL)
+				break;
+			staged = bounce + DISK_SECTOR_SIZE;
+		}
+		if (direct)
+			src = buffer + bytes_written;
+		else {
+			memcpy (staged, buffer + bytes_written, chunk_size);
+			src = staged;
+		}
+
+		rwlock_acquire_write (&inode->rwlock);
+		if (inode->deny_write_cnt) {
+			rwlock_release_write (&inode->rwlock);
+			break;
+		}
+
+		/* Sector to write, bytes left in inode, lesser of bytes left
+		 * in inode and in sector. */
+		sector_idx = byte_to_sector (inode, offset);
+		inode_left = inode_length (inode) - offset;
+		min_left = inode_left < sector_left ? inode_left : sector_left;
 
 		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+		chunk_size = chunk_size < min_left ? chunk_size : min_left;
+		if (chunk_size <= 0) {
+			rwlock_release_write (&inode->rwlock);
 			break;
+		}
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+			disk_write (filesys_disk, sector_idx, src);
 		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
 			/* If the sector contains data before or after the chunk
 			   we're writing, then we need to read in the sector
 			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
+			if (sector_ofs > 0 || chunk_size < sector_left)
 				disk_read (filesys_disk, sector_idx, bounce);
 			else
 				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
+			memcpy (bounce + sector_ofs, src, chunk_size);
+			disk_write (filesys_disk, sector_idx, bounce);
 		}
+		rwlock_release_write (&inode->rwlock);
 
 		/* Advance. */
 		size -= chunk_size;
@@ -292,8 +379,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rwlock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +390,11 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->rwlock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -311,3 +402,12 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Returns the lock that guards the entries of INODE, which must
+ * be a directory.  Lookups take it shared and entry changes take
+ * it exclusive; data transfers still go through INODE's own
+ * lock. */
+struct rwlock *
+inode_dir_lock (struct inode *inode) {
+	return &inode->dir_lock;
+}
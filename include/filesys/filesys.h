@@ -12,9 +12,6 @@
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
-/* Project2 - File Descriptor */
-struct lock filesys_lock;
-
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
@@ -3,6 +3,8 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
 
 /* A counting semaphore. */
 struct semaphore {
@@ -16,10 +18,29 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Spin lock.  Busy-waits with interrupts disabled instead of
+   sleeping, so it may be taken in interrupt context and guards
+   data shared between CPUs.  Must not be held across a sleep. */
+struct spinlock {
+	volatile uint32_t locked;   /* Nonzero while held. */
+	enum intr_level old_level;  /* Interrupt level to restore. */
+};
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+
 /* Lock. */
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct list_elem elem;      /* Element in holder's held_locks list. */
+
+	/* Contention statistics. */
+	long long acquire_cnt;      /* # of successful acquisitions. */
+	long long contend_cnt;      /* # of acquisitions that found it held. */
+	long long spin_cnt;         /* # of contended ones won by spinning. */
+	long long block_cnt;        /* # of contended ones that had to sleep. */
 };
 
 void lock_init (struct lock *);
@@ -27,6 +48,7 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (const struct lock *, const char *name);
 
 /* Condition variable. */
 struct condition {
@@ -38,6 +60,32 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock.  Any number of readers or a single writer
+   may hold it at once.  A writer holds LOCK for its whole
+   critical section, and readers pass through LOCK on entry, so
+   waiters queue on LOCK in priority order, donate to the writer,
+   and new readers cannot overtake a writer that is waiting for
+   the current readers to drain.
+
+   An rwlock must not be held, in either mode, across an access
+   to user memory.  A page fault there may have to load or evict a
+   page backed by a file, which takes the locks of that file's
+   inode, and readers cannot nest.  Copy user data through a kernel
+   buffer instead. */
+struct rwlock {
+	struct lock lock;           /* Held by the writer. */
+	unsigned readers;           /* # of readers inside. */
+	bool writer_waiting;        /* Writer waiting for readers to drain? */
+	struct semaphore drained;   /* Upped by the last reader out. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
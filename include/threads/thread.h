@@ -30,6 +30,21 @@ enum thread_status {
 typedef int tid_t;
 #define TID_ERROR ((tid_t) -1)          /* Error value for tid_t. */
 
+/* Maximum number of CPUs the scheduler keeps state for.
+   Only the bootstrap processor is brought up for now, so the
+   kernel runs one scheduler instance on cpus[0].
+
+   The per-CPU run queues and spin locks are groundwork only.
+   Starting the application processors (a real-mode trampoline,
+   INIT/SIPI through the local APIC, per-CPU GDT, TSS and LAPIC
+   timer) is out of scope for this tree, and code that excludes
+   others by disabling interrupts, such as the malloc() magazines,
+   still assumes a single CPU. */
+#define NCPU 1
+#if NCPU != 1
+#error "Application processor bring-up is not implemented."
+#endif
+
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
@@ -98,17 +113,21 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
+	int cpu;                            /* CPU whose run queue owns us. */
 
   /* customed */
 	int original_priority;				/* original priority (for donation) */
-	int64_t time_to_wakeup; 			/* time to wakeup */
+	int64_t time_to_wakeup; 			/* time to wakeup (sleep heap key) */
 	struct lock *wait_on_lock;			/* wait on lock that points the lock which a thread holds. */
-	struct list donations;				/* donations that points d_elem donors. */
-	struct list_elem d_elem;			/* List donors element. */
+	struct semaphore *wait_on_sema;		/* semaphore whose waiters list holds `elem'. */
+	struct list held_locks;				/* locks held, for computing donations. */
 
 	int nice;							/* nice fields */
 	fp_float recent_cpu;				/* recent_cpu  */
 	struct list_elem adv_elem;			/* for list all threads */
+	int64_t cpu_epoch;					/* # of recent_cpu decays applied */
+	bool mlfqs_dirty;					/* on the MLFQS dirty list? */
+	struct list_elem dirty_elem;		/* MLFQS dirty list element */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -175,6 +194,8 @@ void thread_yield (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_set_effective_priority (struct thread *, int);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -190,10 +211,12 @@ void recent_cpu_add_1(void);
 void recalculate_priority(void);
 void recalculate_recent_cpu(void);
 void calculate_priority(struct thread *t);
+void mlfqs_catch_up(struct thread *t);
 void calculate_load_avg(void);
 void preemption(void);
-void thread_sleep(int64_t tick);
+bool thread_sleep(int64_t tick);
 void thread_wakeup(int64_t tick);
+int64_t get_thread_ttw_tick(void);
 bool list_higher_priority (const struct list_elem *a_, const struct list_elem *b_, void *aux UNUSED);
 struct thread* get_thread(tid_t tid);
 #endif /* threads/thread.h */
\ No newline at end of file
@@ -7,21 +7,36 @@ struct page;
 enum vm_type;
 
 struct anon_page {
-
-    struct swap_anon* swap_anon;
+    size_t swap_slot;           /* Swap slot holding a copy of the page, or
+                                   BITMAP_ERROR.  Kept while the page is in
+                                   a frame: see the swap cache in anon.c. */
+    uint64_t zswap;             /* Compressed copy in zswap, or 0. */
 };
 
-struct swap_anon {
-    bool use;
-    disk_sector_t sectors[8];
-    struct page* page;
-    struct list_elem s_elem;
-
+/* Swap read-ahead state of one address space.  See anon_swap_in(). */
+struct swap_readahead {
+    void *next_va;              /* Fault address that continues the stream. */
+    void *start;                /* First page of the last read-ahead. */
+    size_t cnt;                 /* Pages in the last read-ahead, 0 if judged. */
+    size_t window;              /* Pages to read ahead of the next fault. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+size_t swap_slot_alloc (size_t cnt);
+void swap_slot_free (size_t slot, size_t cnt);
+void swap_print_stats (void);
+size_t anon_swap_out_cluster (struct page *pages[], size_t cnt);
+void anon_copy_swapped (struct page *page, void *kva);
+void swap_readahead_init (struct swap_readahead *);
+
+#define SECTORS_PER_PAGE ((1<<12)/512)
+
+/* Most pages anon_swap_out_cluster() writes at once. */
+#define SWAP_CLUSTER_MAX 8
 
-#define SECTORS_PER_PAGE (1<<12)/512
+/* Smallest and largest read-ahead windows, in pages. */
+#define SWAP_RA_MIN 2
+#define SWAP_RA_MAX 16
 
 #endif
@@ -29,6 +29,7 @@ enum vm_type {
 
 #include "vm/uninit.h"
 #include "vm/anon.h"
+#include "vm/zswap.h"
 #include "vm/file.h"
 #include <hash.h>
 #ifdef EFILESYS
@@ -50,9 +51,10 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
-	struct hash_elem h_elem;
 	bool writable;
 	bool swapped;
+	struct thread *owner;       /* Thread whose spt holds this page. */
+	struct list_elem frame_elem; /* Element in its frame's SHARERS. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -69,8 +71,10 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
-	struct list_elem f_elem;
+	struct page *page;     /* Page the clock evicts, or NULL if none. */
+	struct thread *owner;  /* Thread whose pml4 maps PAGE. */
+	unsigned map_cnt;      /* Number of pages sharing this frame. */
+	struct list sharers;   /* Pages mapping this frame, by frame_elem. */
 };
 
 /* The function table for page operations.
@@ -93,8 +97,9 @@ struct page_operations {
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
-	struct hash hash_brown;
+	uint64_t root;              /* Radix tree of pages, see vm/spt.c. */
 	struct hash swap_table;
+	struct swap_readahead ra;   /* Swap read-ahead state. */
 };
 
 #include "threads/thread.h"
@@ -107,7 +112,34 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
+/* Called on each page by spt_walk_range().  Returns false to stop. */
+typedef bool spt_walk_func (struct page *page, void *aux);
+bool spt_walk_range (struct supplemental_page_table *spt, void *start,
+		void *end, spt_walk_func *func, void *aux);
+void spt_remove_range (struct supplemental_page_table *spt, void *start,
+		void *end);
+bool spt_range_empty (struct supplemental_page_table *spt, void *start,
+		void *end);
+
+extern bool vm_two_handed_clock;
+
+/* Page-out statistics, for tuning the kswapd watermarks. */
+struct vm_stats {
+	long long kswapd_wakeups;   /* Times kswapd was woken. */
+	long long kswapd_evictions; /* Frames freed by kswapd. */
+	long long direct_evictions; /* Frames evicted by faulting threads. */
+	long long anon_writebacks;  /* Anonymous pages written to swap. */
+	long long file_writebacks;  /* Dirty file pages written back. */
+	long long readahead_pages;  /* Pages read ahead from swap. */
+	long long readahead_hits;   /* Of those, pages used before eviction. */
+	long long swap_cache_drops; /* Clean anonymous pages evicted unwritten. */
+};
+extern struct vm_stats vm_stats;
+
 void vm_init (void);
+void vm_print_stats (void);
+struct frame *vm_get_spare_frame (void);
+bool vm_install_frame (struct page *page, struct frame *frame);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -116,13 +148,10 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
+void vm_release_frame (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
 
-uint64_t hash_hash_func_impl(const struct hash_elem *e, void *aux);
-bool hash_less_func_impl (const struct hash_elem *a_, const struct hash_elem *b_, void *aux);
-void hash_action_func_impl (struct hash_elem *e, void *aux);
-
 /* Project 3 */
 struct lazy_load_info
 {
@@ -132,8 +161,6 @@ struct lazy_load_info
 	size_t zero_bytes;
 };
 
-struct list frame_table;
-struct lock frame_lock;
 #include "threads/vaddr.h"
 #define MAX_STACK_BOTTOM	USER_STACK - 0x100000	// 1MB
 // #define MAX_STACK_BOTTOM	USER_STACK - (1<<20)	// 1MB
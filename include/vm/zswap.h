@@ -0,0 +1,35 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* If true, evicted anonymous pages are compressed into memory before
+ * they go to the swap disk.  Controlled by kernel command-line option
+ * "-zswap". */
+extern bool zswap_enabled;
+
+/* Most pages the compressed pool may take, or 0 for the default.
+ * Set by "-zswap=PAGES". */
+extern size_t zswap_max_pages;
+
+/* Compressed swap statistics. */
+struct zswap_stats {
+	long long stores;           /* Pages compressed into the pool. */
+	long long zero_stores;      /* Of those, zero-filled pages. */
+	long long hits;             /* Swap-ins served from the pool. */
+	long long rejects_full;     /* Pages turned away by a full pool. */
+	long long rejects_poor;     /* Pages that did not compress well. */
+	long long writebacks;       /* Pages written to disk instead. */
+	long long stored_bytes;     /* Compressed size of the non-zero stores. */
+};
+extern struct zswap_stats zswap_stats;
+
+void zswap_init (void);
+bool zswap_store (const void *kva, uint64_t *handle);
+void zswap_load (uint64_t handle, void *kva);
+void zswap_peek (uint64_t handle, void *kva);
+void zswap_free (uint64_t handle);
+void zswap_print_stats (void);
+
+#endif
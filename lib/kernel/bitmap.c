@@ -63,6 +63,63 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type in which bits LO through HI, exclusive,
+   are turned on, where 0 <= LO < HI <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t lo, size_t hi) {
+	elem_type ones = hi - lo < ELEM_BITS
+		? ((elem_type) 1 << (hi - lo)) - 1 : (elem_type) -1;
+	return ones << lo;
+}
+
+/* Returns the number of bits turned on in E.  The kernel does
+   not link against libgcc, so __builtin_popcountl() is out. */
+static inline size_t
+elem_popcount (elem_type e) {
+	e = e - ((e >> 1) & (elem_type) 0x5555555555555555ULL);
+	e = (e & (elem_type) 0x3333333333333333ULL)
+		+ ((e >> 2) & (elem_type) 0x3333333333333333ULL);
+	e = (e + (e >> 4)) & (elem_type) 0x0f0f0f0f0f0f0f0fULL;
+	return (e * (elem_type) 0x0101010101010101ULL) >> (ELEM_BITS - 8);
+}
+
+/* Sets the bits of MASK in the element numbered IDX in B to
+   VALUE, atomically as bitmap_mark() and bitmap_reset() do. */
+static inline void
+elem_set (struct bitmap *b, size_t idx, elem_type mask, bool value) {
+	if (value)
+		asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	else
+		asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+}
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's size if there is none.  Skips whole
+   elements that hold no such bit. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value) {
+	size_t idx = elem_idx (start);
+	size_t last_idx = elem_cnt (b->bit_cnt);
+	elem_type flip = value ? 0 : (elem_type) -1;
+	elem_type e;
+	size_t bit;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	/* Turn bits set to VALUE into 1s, ignoring those before START. */
+	e = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+	while (e == 0) {
+		if (++idx >= last_idx)
+			return b->bit_cnt;
+		e = b->bits[idx] ^ flip;
+	}
+
+	/* The unused bits of the last element may look like a match. */
+	bit = idx * ELEM_BITS + __builtin_ctzl (e);
+	return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -197,46 +254,65 @@ bitmap_set_all (struct bitmap *b, bool value) {
 /* Sets the CNT bits starting at START in B to VALUE. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	/* One element at a time. */
+	while (start < end) {
+		size_t ofs = start % ELEM_BITS;
+		size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+
+		elem_set (b, elem_idx (start), range_mask (ofs, ofs + n), value);
+		start += n;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t true_cnt = 0;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	/* Count true bits one element at a time. */
+	while (start < end) {
+		size_t ofs = start % ELEM_BITS;
+		size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+
+		true_cnt += elem_popcount (b->bits[elem_idx (start)]
+				& range_mask (ofs, ofs + n));
+		start += n;
+	}
+	return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
+	elem_type flip = value ? 0 : (elem_type) -1;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
+	/* Test one element at a time. */
+	while (start < end) {
+		size_t ofs = start % ELEM_BITS;
+		size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+
+		if ((b->bits[elem_idx (start)] ^ flip) & range_mask (ofs, ofs + n))
 			return true;
+		start += n;
+	}
 	return false;
 }
 
@@ -266,7 +342,11 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Rather than testing every candidate position, we jump from the
+   start of each run of VALUE bits to its end, a word at a time,
+   so a region with no VALUE bits costs one test per element. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
@@ -274,10 +354,21 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+		size_t i = start;
+
+		if (cnt == 0)
+			return start <= last ? start : BITMAP_ERROR;
+		while (i <= last) {
+			size_t run_start = find_next (b, i, value);
+			size_t run_end;
+
+			if (run_start > last)
+				break;
+			run_end = find_next (b, run_start, !value);
+			if (run_end - run_start >= cnt)
+				return run_start;
+			i = run_end;
+		}
 	}
 	return BITMAP_ERROR;
 }
@@ -1,5 +1,22 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* The block functions below work a machine word at a time, using
+   x86-64's string instructions where they apply.  The kernel is
+   built with -mno-sse and does not save SSE state across context
+   switches, so wider vector registers are not an option here.
+
+   A word that may alias any other type, for word-wide loads from
+   byte buffers. */
+typedef uint64_t __attribute__ ((__may_alias__)) word_t;
+
+#define WORD_SIZE sizeof (word_t)
+#define ONES ((word_t) 0x0101010101010101ULL)
+#define HIGHS ((word_t) 0x8080808080808080ULL)
+
+/* True if some byte of word W is zero. */
+#define HAS_ZERO_BYTE(W) ((((W) - ONES) & ~(W) & HIGHS) != 0)
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,8 +28,12 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = *src++;
+	size_t words = size / WORD_SIZE;
+	size_t bytes = size % WORD_SIZE;
+	asm volatile ("rep movsq"
+			: "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+	asm volatile ("rep movsb"
+			: "+D" (dst), "+S" (src), "+c" (bytes) : : "memory");
 
 	return dst_;
 }
@@ -52,6 +73,12 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip the equal prefix a word at a time, then locate the
+	   differing byte, if any, one byte at a time. */
+	for (; size >= WORD_SIZE; a += WORD_SIZE, b += WORD_SIZE, size -= WORD_SIZE)
+		if (*(const word_t *) a != *(const word_t *) b)
+			break;
+
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -257,11 +284,16 @@ strtok_r (char *s, const char *delimiters, char **save_ptr) {
 void *
 memset (void *dst_, int value, size_t size) {
 	unsigned char *dst = dst_;
+	word_t pattern = ONES * (unsigned char) value;
 
 	ASSERT (dst != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = value;
+	size_t words = size / WORD_SIZE;
+	size_t bytes = size % WORD_SIZE;
+	asm volatile ("rep stosq"
+			: "+D" (dst), "+c" (words) : "a" (pattern) : "memory");
+	asm volatile ("rep stosb"
+			: "+D" (dst), "+c" (bytes) : "a" (pattern) : "memory");
 
 	return dst_;
 }
@@ -273,7 +305,15 @@ strlen (const char *string) {
 
 	ASSERT (string);
 
-	for (p = string; *p != '\0'; p++)
+	/* Scan bytes up to a word boundary, then whole words until one
+	   contains a null byte.  An aligned word never straddles a
+	   page boundary, so we cannot fault past the terminator. */
+	for (p = string; (uintptr_t) p % WORD_SIZE != 0; p++)
+		if (*p == '\0')
+			return p - string;
+	while (!HAS_ZERO_BYTE (*(const word_t *) p))
+		p += WORD_SIZE;
+	for (; *p != '\0'; p++)
 		continue;
 	return p - string;
 }
@@ -0,0 +1,148 @@
+/* Microbenchmark for the supplemental page table lookup that starts
+   every page fault.
+
+   vm_try_handle_fault() looks up the faulting page before anything
+   else.  This fills a table with PAGE_CNT pages laid out like a
+   process image and times LOOKUP_CNT lookups of them, at unaligned
+   addresses in a scattered order, two ways:
+
+     - "before": hash_find() on a chained hash table, with a dummy
+       struct page allocated and freed around each lookup, as
+       spt_find_page() did before the SPT became a radix tree;
+
+     - "after": spt_find_page() on the radix tree in vm/spt.c.
+
+   Results are reported in CPU cycles per lookup, as read from the
+   time-stamp counter.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Number of pages in the table, and number of timed lookups. */
+#define PAGE_CNT 16384
+#define LOOKUP_CNT 65536
+
+/* Stand-in for struct page as it was when the SPT was a hash. */
+struct bench_page
+  {
+    struct hash_elem elem;
+    void *va;
+  };
+
+static uint64_t page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+                       void *);
+static void *nth_addr (unsigned n);
+static uint64_t rdtsc (void);
+static void report (const char *name, uint64_t cycles);
+
+/* Benchmark the lookups. */
+void
+test (void)
+{
+  struct supplemental_page_table *spt = &thread_current ()->spt;
+  struct bench_page *pages;
+  struct hash chained;
+  uint64_t start;
+  unsigned i;
+
+  pages = malloc (sizeof *pages * PAGE_CNT);
+  ASSERT (pages != NULL);
+  ASSERT (hash_init (&chained, page_hash, page_less, NULL));
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      pages[i].va = pg_round_down (nth_addr (i));
+      ASSERT (hash_insert (&chained, &pages[i].elem) == NULL);
+      ASSERT (vm_alloc_page (VM_ANON, pages[i].va, true));
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      struct bench_page *key = malloc (sizeof (struct page));
+      struct hash_elem *e;
+
+      key->va = pg_round_down (nth_addr (i * 7919));
+      e = hash_find (&chained, &key->elem);
+      ASSERT (e != NULL
+              && hash_entry (e, struct bench_page, elem)->va == key->va);
+      free (key);
+    }
+  report ("before", rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      void *addr = nth_addr (i * 7919);
+      struct page *p = spt_find_page (spt, pg_round_down (addr));
+
+      ASSERT (p != NULL && p->va == pg_round_down (addr));
+    }
+  report ("after", rdtsc () - start);
+
+  supplemental_page_table_kill (spt);
+  hash_destroy (&chained, NULL);
+  free (pages);
+}
+
+/* Hashes a bench_page by its virtual address. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct bench_page *p = hash_entry (e, struct bench_page, elem);
+  return hash_bytes (&p->va, sizeof p->va);
+}
+
+/* Orders bench_pages by virtual address. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct bench_page *a = hash_entry (a_, struct bench_page, elem);
+  const struct bench_page *b = hash_entry (b_, struct bench_page, elem);
+  return a->va < b->va;
+}
+
+/* Returns an address inside page N modulo PAGE_CNT, laid out like a
+   process image: the first half of the pages from the bottom of the
+   address space up, the rest from the stack down. */
+static void *
+nth_addr (unsigned n)
+{
+  uint64_t ofs = (n * 40503u) % PGSIZE;
+
+  n %= PAGE_CNT;
+  if (n < PAGE_CNT / 2)
+    return (void *) (0x400000 + (uint64_t) n * PGSIZE + ofs);
+  return (void *) (USER_STACK - (uint64_t) (n - PAGE_CNT / 2 + 1) * PGSIZE
+                   + ofs);
+}
+
+/* Returns the current value of the time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Prints the average cost of LOOKUP_CNT lookups named NAME that
+   took CYCLES cycles in total. */
+static void
+report (const char *name, uint64_t cycles)
+{
+  printf ("%-7s %llu cycles/lookup\n", name, cycles / LOOKUP_CNT);
+}
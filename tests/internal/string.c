@@ -0,0 +1,92 @@
+/* Microbenchmark for the block functions in lib/string.c.
+
+   Times memcpy(), memset(), memcmp() and strlen() on buffers of
+   several sizes, checks their results, and reports throughput in
+   hundredths of a byte per CPU cycle, as read from the time-stamp
+   counter.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+
+/* Largest block size we benchmark, and the number of times each
+   block is processed per measurement. */
+#define MAX_SIZE 4096
+#define REPEAT 256
+
+static uint8_t src[MAX_SIZE + 1], dst[MAX_SIZE + 1];
+
+static uint64_t rdtsc (void);
+static void report (const char *name, size_t size, uint64_t cycles);
+
+/* Benchmark the block functions. */
+void
+test (void)
+{
+  static const size_t sizes[] = {16, 64, 256, 1024, 4096};
+  size_t i;
+
+  for (i = 0; i < MAX_SIZE; i++)
+    src[i] = (i % 255) + 1;
+  src[MAX_SIZE] = '\0';
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i];
+      uint64_t start;
+      int repeat;
+
+      start = rdtsc ();
+      for (repeat = 0; repeat < REPEAT; repeat++)
+        memcpy (dst, src, size);
+      report ("memcpy", size, rdtsc () - start);
+      ASSERT (!memcmp (dst, src, size));
+
+      start = rdtsc ();
+      for (repeat = 0; repeat < REPEAT; repeat++)
+        ASSERT (memcmp (dst, src, size) == 0);
+      report ("memcmp", size, rdtsc () - start);
+
+      start = rdtsc ();
+      for (repeat = 0; repeat < REPEAT; repeat++)
+        memset (dst, repeat, size);
+      report ("memset", size, rdtsc () - start);
+      ASSERT (dst[0] == (uint8_t) (REPEAT - 1)
+              && dst[size - 1] == (uint8_t) (REPEAT - 1));
+
+      src[size] = '\0';
+      start = rdtsc ();
+      for (repeat = 0; repeat < REPEAT; repeat++)
+        ASSERT (strlen ((const char *) src) == size);
+      report ("strlen", size, rdtsc () - start);
+      if (size < MAX_SIZE)
+        src[size] = (size % 255) + 1;
+    }
+}
+
+/* Returns the current value of the time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Prints the throughput of REPEAT calls of NAME on SIZE bytes
+   that took CYCLES cycles in total. */
+static void
+report (const char *name, size_t size, uint64_t cycles)
+{
+  uint64_t centibytes = (uint64_t) size * REPEAT * 100 / (cycles ? cycles : 1);
+
+  printf ("%s %4zu bytes: %llu.%02llu bytes/cycle\n", name, size,
+          centibytes / 100, centibytes % 100);
+}
@@ -0,0 +1,57 @@
+/* Runs swap nearly out of space while pages are being evicted.
+ * The user pool is limited to 256 frames and the swap disk to
+ * 256 slots, and the test keeps about 480 pages of data live, so
+ * the page-out daemon regularly finds no free slot for a victim
+ * and has to give the page its mapping back.  A fault on such a
+ * page that raced with the failed eviction must see the page's
+ * data, not a fresh zero-filled frame.  Every pass checks and then
+ * rewrites a different value in every page. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_COUNT 480
+#define PASS_COUNT 4
+
+static char big_chunks[PAGE_COUNT * PAGE_SIZE];
+
+/* Returns the value page I holds after pass PASS. */
+static uint64_t
+page_value (size_t i, int pass)
+{
+  return ((uint64_t) i * 2654435761u) ^ ((uint64_t) pass << 40);
+}
+
+void
+test_main (void)
+{
+  size_t i;
+  int pass;
+
+  for (i = 0; i < PAGE_COUNT; i++)
+    {
+      uint64_t *mem = (uint64_t *) (big_chunks + i * PAGE_SIZE);
+      mem[0] = page_value (i, 0);
+      mem[PAGE_SIZE / sizeof *mem - 1] = ~page_value (i, 0);
+    }
+  msg ("wrote %d pages", PAGE_COUNT);
+
+  for (pass = 1; pass <= PASS_COUNT; pass++)
+    {
+      for (i = 0; i < PAGE_COUNT; i++)
+        {
+          uint64_t *mem = (uint64_t *) (big_chunks + i * PAGE_SIZE);
+          if (mem[0] != page_value (i, pass - 1)
+              || mem[PAGE_SIZE / sizeof *mem - 1] != ~page_value (i, pass - 1))
+            fail ("data is inconsistent in page %zu", i);
+          mem[0] = page_value (i, pass);
+          mem[PAGE_SIZE / sizeof *mem - 1] = ~page_value (i, pass);
+        }
+      msg ("pass %d consistent", pass);
+    }
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-full) begin
+(swap-full) wrote 480 pages
+(swap-full) pass 1 consistent
+(swap-full) pass 2 consistent
+(swap-full) pass 3 consistent
+(swap-full) pass 4 consistent
+(swap-full) end
+EOF
+pass;
@@ -6,7 +6,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,7 +34,17 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of each descriptor sits a small stack of free blocks
+   called a "magazine".  malloc() and free() are served from the
+   magazine with interrupts briefly disabled instead of taking the
+   descriptor lock.  Only when the
+   magazine runs empty or full do we take the lock and move
+   MAG_BATCH blocks between it and the descriptor's free list.
+   Blocks sitting in a magazine still count as in use in their
+   arena, so an arena is only returned to the page allocator
+   once its blocks have been flushed back. */
 
 /*
 	각 요청의 크기(바이트 단위)는 2의 제곱수로 반올림되어 해당 크기의 블록을 관리하는 "디스크립터"에 할당된다.
@@ -56,6 +68,23 @@ struct desc {
 	struct lock lock;           /* Lock. */
 };
 
+/* Blocks a magazine holds, and blocks moved per refill or
+   flush. */
+#define MAG_SIZE 32
+#define MAG_BATCH 16
+
+/* Cache of free blocks for one descriptor. */
+struct magazine {
+	size_t cnt;                 /* Number of blocks in ROUNDS. */
+	struct block *rounds[MAG_SIZE]; /* Free blocks, top at CNT - 1. */
+
+	/* Statistics. */
+	long long alloc_hits;       /* # of mallocs served from ROUNDS. */
+	long long alloc_misses;     /* # of mallocs that refilled. */
+	long long free_hits;        /* # of frees absorbed by ROUNDS. */
+	long long free_misses;      /* # of frees that flushed. */
+};
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -75,8 +104,14 @@ struct block {
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Magazines, indexed by descriptor. */
+static struct magazine mags[sizeof descs / sizeof *descs];
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct magazine *desc_magazine (struct desc *);
+static size_t desc_take (struct desc *, struct block **, size_t cnt);
+static void desc_put (struct desc *, struct block **, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -100,6 +135,10 @@ malloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
+	struct magazine *m;
+	struct block *batch[MAG_BATCH];
+	enum intr_level old_level;
+	size_t i, n;
 
 	/* A null pointer satisfies a request for 0 bytes. */
 	if (size == 0)
@@ -126,34 +165,36 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
-
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
-
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
-
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
-		}
+	/* Fast path: pop a block off the magazine. */
+	old_level = intr_disable ();
+	m = desc_magazine (d);
+	if (m->cnt > 0) {
+		m->alloc_hits++;
+		b = m->rounds[--m->cnt];
+		intr_set_level (old_level);
+		return b;
 	}
+	m->alloc_misses++;
+	intr_set_level (old_level);
+
+	/* Slow path: take a batch from the descriptor, at most an
+	   arena's worth, keep the first block for ourselves and load
+	   the rest into the magazine.
+	   We may have slept on the descriptor lock, so anything that
+	   no longer fits goes back. */
+	n = desc_take (d, batch, MIN (MAG_BATCH, d->blocks_per_arena));
+	if (n == 0)
+		return NULL;
+	b = batch[0];
 
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
-	lock_release (&d->lock);
+	old_level = intr_disable ();
+	m = desc_magazine (d);
+	for (i = 1; i < n && m->cnt < MAG_SIZE; i++)
+		m->rounds[m->cnt++] = batch[i];
+	intr_set_level (old_level);
+
+	if (i < n)
+		desc_put (d, batch + i, n - i);
 	return b;
 }
 
@@ -221,30 +262,36 @@ free (void *p) {
 
 		if (d != NULL) {
 			/* It's a normal block.  We handle it here. */
+			struct block *batch[MAG_BATCH];
+			struct magazine *m;
+			enum intr_level old_level;
 
 #ifndef NDEBUG
 			/* Clear the block to help detect use-after-free bugs. */
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			/* Fast path: push the block onto the magazine.
+			   If it is full, flush its oldest MAG_BATCH blocks to
+			   the descriptor to make room, keeping the more
+			   recently freed (cache-hot) ones. */
+			old_level = intr_disable ();
+			m = desc_magazine (d);
+			if (m->cnt < MAG_SIZE) {
+				m->free_hits++;
+				m->rounds[m->cnt++] = b;
+				intr_set_level (old_level);
+				return;
 			}
-
-			lock_release (&d->lock);
+			m->free_misses++;
+			memcpy (batch, m->rounds, sizeof batch);
+			memmove (m->rounds, m->rounds + MAG_BATCH,
+					(MAG_SIZE - MAG_BATCH) * sizeof *m->rounds);
+			m->cnt -= MAG_BATCH;
+			m->rounds[m->cnt++] = b;
+			intr_set_level (old_level);
+
+			desc_put (d, batch, MAG_BATCH);
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -253,6 +300,107 @@ free (void *p) {
 	}
 }
 
+/* Moves up to CNT free blocks from descriptor D into BLOCKS,
+   creating a new arena if D's free list runs dry.  Returns the
+   number of blocks moved, which is 0 only if memory is not
+   available. */
+static size_t
+desc_take (struct desc *d, struct block **blocks, size_t cnt) {
+	size_t n;
+
+	lock_acquire (&d->lock);
+	for (n = 0; n < cnt; n++) {
+		struct block *b;
+		struct arena *a;
+
+		/* If the free list is empty, create a new arena. */
+		if (list_empty (&d->free_list)) {
+			size_t i;
+
+			/* Allocate a page. */
+			a = palloc_get_page (0);
+			if (a == NULL)
+				break;
+
+			/* Initialize arena and add its blocks to the free list. */
+			a->magic = ARENA_MAGIC;
+			a->desc = d;
+			a->free_cnt = d->blocks_per_arena;
+			for (i = 0; i < d->blocks_per_arena; i++) {
+				struct block *b = arena_to_block (a, i);
+				list_push_back (&d->free_list, &b->free_elem);
+			}
+		}
+
+		/* Get a block from free list. */
+		b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+		a = block_to_arena (b);
+		a->free_cnt--;
+		blocks[n] = b;
+	}
+	lock_release (&d->lock);
+	return n;
+}
+
+/* Returns the CNT blocks in BLOCKS to descriptor D's free list,
+   giving back to the page allocator any arena that becomes
+   entirely unused. */
+static void
+desc_put (struct desc *d, struct block **blocks, size_t cnt) {
+	size_t n;
+
+	lock_acquire (&d->lock);
+	for (n = 0; n < cnt; n++) {
+		struct block *b = blocks[n];
+		struct arena *a = block_to_arena (b);
+
+		/* Add block to free list. */
+		list_push_front (&d->free_list, &b->free_elem);
+
+		/* If the arena is now entirely unused, free it. */
+		if (++a->free_cnt >= d->blocks_per_arena) {
+			size_t i;
+
+			ASSERT (a->free_cnt == d->blocks_per_arena);
+			for (i = 0; i < d->blocks_per_arena; i++) {
+				struct block *b = arena_to_block (a, i);
+				list_remove (&b->free_elem);
+			}
+			palloc_free_page (a);
+		}
+	}
+	lock_release (&d->lock);
+}
+
+/* Returns the magazine for descriptor D.  Interrupts must be
+   off, so that no other thread touches the magazine meanwhile. */
+static struct magazine *
+desc_magazine (struct desc *d) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	return &mags[d - descs];
+}
+
+/* Prints magazine hit rates and contention statistics for the
+   descriptor locks. */
+void
+malloc_print_stats (void) {
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++) {
+		struct magazine *m = &mags[d - descs];
+		long long allocs = m->alloc_hits + m->alloc_misses;
+		long long frees = m->free_hits + m->free_misses;
+		char name[16];
+
+		snprintf (name, sizeof name, "malloc-%zu", d->block_size);
+		if (allocs > 0)
+			printf ("Magazine %s: %lld allocs, %lld%% hit; %lld frees, "
+					"%lld%% hit\n", name, allocs, m->alloc_hits * 100 / allocs,
+					frees, frees > 0 ? m->free_hits * 100 / frees : 0);
+		lock_print_stats (&d->lock, name);
+	}
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
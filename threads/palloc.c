@@ -2,12 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,7 +26,30 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  A free "block" of order K is 2**K pages whose index
+   within the pool is a multiple of 2**K, and the pool keeps one
+   free list per order.  A request for N pages takes a block of
+   the smallest order that fits, splitting larger blocks as
+   needed, and gives back the tail beyond N pages.  A freed range
+   is broken into aligned blocks, each of which is merged with
+   its "buddy" (the other half of the next larger block) for as
+   long as that buddy is free too.  Both take time logarithmic in
+   the pool size.
+
+   The free list links and block orders live in arrays next to
+   the pool's used_map rather than in the free pages themselves,
+   since not all of memory is mapped yet when the pools are
+   populated.
+
+   Each pool also keeps a small reserve of single pages that are
+   already zeroed, so that PAL_ZERO requests (notably every user
+   page fault) need not clear the page on the spot.  The idle
+   thread refills the reserve by calling palloc_zero_idle(), and
+   any request falls back on it when the buddy allocator runs
+   dry, so reserved pages are never lost to the system. */
 
 /*
 	페이지 할당기.
@@ -38,11 +63,33 @@
 	이는 커널 풀에 엄청나게 많은 메모리를 할당하는 것이지만, 시연 목적으로는 괜찮다.
 */
 
+/* Largest block order the buddy allocator forms. */
+#define MAX_ORDER 20
+
+/* Value of a pool's orders[] for a page that does not start a
+   free block. */
+#define NOT_FREE 0xff
+
+/* Maximum number of pre-zeroed pages a pool holds in reserve. */
+#define ZEROED_MAX 64
+
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+	struct list_elem *links;        /* Per page: free list element. */
+	uint8_t *orders;                /* Per page: free block order. */
+	size_t free_cnt;                /* Pages on the free lists. */
+
+	/* Pre-zeroed pages.  They are allocated as far as the buddy
+	   allocator is concerned, so they reuse its per-page links. */
+	struct spinlock zeroed_lock;    /* Protects the members below. */
+	struct list zeroed;             /* Zeroed pages ready for use. */
+	size_t zeroed_cnt;              /* Number of pages in ZEROED. */
+	long long zero_requests;        /* # of single-page PAL_ZERO requests. */
+	long long zero_hits;            /* # of those served from ZEROED. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -54,6 +101,10 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void *zeroed_pop (struct pool *, bool zero_request);
+static bool zero_one_page (struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -236,11 +287,13 @@ split:
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free_range (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free_range (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -275,20 +328,33 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
+	/* Serve single zeroed pages from the reserve if we can. */
+	if (page_cnt == 1 && (flags & PAL_ZERO)) {
+		void *page = zeroed_pop (pool, true);
+		if (page != NULL)
+			return page;
+	}
+
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	size_t page_idx = buddy_alloc (pool, page_cnt);
+	if (page_idx != BITMAP_ERROR) {
+		ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
 	lock_release (&pool->lock);
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
+	if (page_idx != BITMAP_ERROR) {
 		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
-
-	if (pages) {
 		if (flags & PAL_ZERO)
 			memset (pages, 0, PGSIZE * page_cnt);
-	} else {
+	} else if (page_cnt == 1) {
+		/* Out of free pages: fall back on the zeroed reserve. */
+		pages = zeroed_pop (pool, false);
+	} else
+		pages = NULL;
+
+	if (pages == NULL) {
 		if (flags & PAL_ASSERT)
 			PANIC ("palloc_get: out of pages");
 	}
@@ -330,8 +396,11 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	lock_acquire (&pool->lock);
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	buddy_free_range (pool, page_idx, page_cnt);
+	lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -340,25 +409,227 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool, counting any that
+   are not usable RAM. */
+size_t
+palloc_user_page_cnt (void) {
+	return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the index of PAGE, which must have been allocated from
+   the user pool, within that pool.  Indexes are less than
+   palloc_user_page_cnt(). */
+size_t
+palloc_user_page_idx (const void *page) {
+	ASSERT (page_from_pool (&user_pool, (void *) page));
+	return pg_no (page) - pg_no (user_pool.base);
+}
+
+/* Returns the number of free pages in the user pool, including
+   its zeroed reserve.  The count is read without locking, so it
+   may be slightly stale. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.free_cnt + user_pool.zeroed_cnt;
+}
+
+/* Zeroes one free page into the reserve of a pool that is not
+   full, for the idle thread.  Returns true if it did, false if
+   there was nothing to do.  Never sleeps, since the idle thread
+   must not block. */
+bool
+palloc_zero_idle (void) {
+	/* User pages are the ones page faults ask for. */
+	return zero_one_page (&user_pool) || zero_one_page (&kernel_pool);
+}
+
+/* Prints the zeroed reserve's hit rate and contention statistics
+   for the pool locks. */
+void
+palloc_print_stats (void) {
+	if (user_pool.zero_requests > 0)
+		printf ("Zeroed pages: %lld of %lld user PAL_ZERO requests served "
+				"pre-zeroed\n", user_pool.zero_hits, user_pool.zero_requests);
+	lock_print_stats (&kernel_pool.lock, "kernel_pool");
+	lock_print_stats (&user_pool.lock, "user_pool");
+}
+
+/* Removes and returns a page from POOL's zeroed reserve, or a
+   null pointer if it is empty.  ZERO_REQUEST says whether this
+   is a PAL_ZERO request, for statistics. */
+static void *
+zeroed_pop (struct pool *pool, bool zero_request) {
+	size_t page_idx;
+
+	spinlock_acquire (&pool->zeroed_lock);
+	if (zero_request)
+		pool->zero_requests++;
+	if (list_empty (&pool->zeroed)) {
+		spinlock_release (&pool->zeroed_lock);
+		return NULL;
+	}
+	if (zero_request)
+		pool->zero_hits++;
+	page_idx = list_pop_front (&pool->zeroed) - pool->links;
+	pool->zeroed_cnt--;
+	spinlock_release (&pool->zeroed_lock);
+
+	return pool->base + PGSIZE * page_idx;
+}
+
+/* Takes a free page from POOL, zeroes it, and adds it to POOL's
+   zeroed reserve, unless the reserve is full or the pool is busy
+   or out of free pages.  Returns true if a page was added.
+
+   This runs in the idle thread, which must never take a sleeping
+   lock: a contended lock would donate priority to the idle thread
+   and try to move it between run queues it is not on.  Instead the
+   page is taken with interrupts off, and only if no thread is
+   inside the pool's critical section, which on a uniprocessor
+   nobody can then enter until interrupts are back on. */
+static bool
+zero_one_page (struct pool *pool) {
+	size_t page_idx = BITMAP_ERROR;
+	enum intr_level old_level;
+
+	if (pool->zeroed_cnt >= ZEROED_MAX)
+		return false;
+
+	old_level = intr_disable ();
+	if (pool->lock.semaphore.value > 0) {
+		page_idx = buddy_alloc (pool, 1);
+		if (page_idx != BITMAP_ERROR)
+			bitmap_mark (pool->used_map, page_idx);
+	}
+	intr_set_level (old_level);
+	if (page_idx == BITMAP_ERROR)
+		return false;
+
+	memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+	spinlock_acquire (&pool->zeroed_lock);
+	list_push_back (&pool->zeroed, &pool->links[page_idx]);
+	pool->zeroed_cnt++;
+	spinlock_release (&pool->zeroed_lock);
+	return true;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map at its base, followed by the
+     buddy allocator's per-page links and orders.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t bm_size = ROUND_UP (bitmap_buf_size (pgcnt), sizeof (struct list_elem));
+	size_t links_size = pgcnt * sizeof *p->links;
+	size_t bm_pages = DIV_ROUND_UP (bm_size + links_size + pgcnt, PGSIZE) * PGSIZE;
+	size_t order;
 
 	lock_init(&p->lock);
-	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_size);
+	p->links = (struct list_elem *) ((uint8_t *) *bm_base + bm_size);
+	p->orders = (uint8_t *) p->links + links_size;
 	p->base = (void *) start;
+	p->free_cnt = 0;
+	for (order = 0; order <= MAX_ORDER; order++)
+		list_init (&p->free_lists[order]);
+	spinlock_init (&p->zeroed_lock);
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+	p->zero_requests = 0;
+	p->zero_hits = 0;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	memset (p->orders, NOT_FREE, pgcnt);
 
 	*bm_base += bm_pages;
 }
 
+/* Removes a block of at least PAGE_CNT pages from POOL's free
+   lists, splitting larger blocks as needed, and frees any pages
+   past the first PAGE_CNT again.  Returns the index of the first
+   page, or BITMAP_ERROR if no block is large enough.  POOL's
+   lock must be held. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	size_t want, order, page_idx;
+
+	if (page_cnt == 0)
+		return BITMAP_ERROR;
+
+	/* Smallest order that holds PAGE_CNT pages. */
+	for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+		if (want == MAX_ORDER)
+			return BITMAP_ERROR;
+
+	/* Smallest nonempty free list of at least that order. */
+	for (order = want; order <= MAX_ORDER; order++)
+		if (!list_empty (&pool->free_lists[order]))
+			break;
+	if (order > MAX_ORDER)
+		return BITMAP_ERROR;
+
+	page_idx = list_pop_front (&pool->free_lists[order]) - pool->links;
+	pool->orders[page_idx] = NOT_FREE;
+
+	/* Split down to the wanted order, freeing upper halves. */
+	while (order > want) {
+		size_t buddy;
+
+		order--;
+		buddy = page_idx + ((size_t) 1 << order);
+		pool->orders[buddy] = order;
+		list_push_front (&pool->free_lists[order], &pool->links[buddy]);
+	}
+
+	/* Give back the unrequested tail of the block. */
+	pool->free_cnt -= (size_t) 1 << want;
+	buddy_free_range (pool, page_idx + page_cnt,
+			((size_t) 1 << want) - page_cnt);
+	return page_idx;
+}
+
+/* Adds the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   lists, as the largest aligned blocks that cover them, and
+   merges each block with its free buddies.  POOL's lock must be
+   held, except during initialization. */
+static void
+buddy_free_range (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t pool_pages = bitmap_size (pool->used_map);
+
+	pool->free_cnt += page_cnt;
+	while (page_cnt > 0) {
+		size_t order = 0;
+		size_t next;
+
+		/* Largest block aligned at PAGE_IDX that fits. */
+		while (order < MAX_ORDER
+				&& (page_idx & ((size_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		next = page_idx + ((size_t) 1 << order);
+		page_cnt -= (size_t) 1 << order;
+
+		/* Merge with the buddy while it is a free block of the
+		   same order. */
+		for (; order < MAX_ORDER; order++) {
+			size_t buddy = page_idx ^ ((size_t) 1 << order);
+			if (buddy >= pool_pages || pool->orders[buddy] != order)
+				break;
+			list_remove (&pool->links[buddy]);
+			pool->orders[buddy] = NOT_FREE;
+			page_idx &= ~((size_t) 1 << order);
+		}
+
+		pool->orders[page_idx] = order;
+		list_push_front (&pool->free_lists[order], &pool->links[page_idx]);
+		page_idx = next;
+	}
+}
+
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
@@ -0,0 +1,275 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator for fixed-size kernel objects.
+
+   malloc() rounds every request up to a power of 2, so an object
+   a little larger than a power of 2 wastes nearly half of its
+   block.  A "cache" instead hands out objects of exactly one
+   size, packed into page-sized "slabs" obtained from the page
+   allocator.  Each slab starts with a header and keeps its free
+   objects on a singly linked list threaded through the objects
+   themselves.
+
+   A cache may have a constructor, which runs once per object
+   when its slab is created.  Callers are expected to return
+   objects to the cache in their constructed state (e.g. with any
+   embedded locks released), so that kmem_cache_alloc() need not
+   construct them again.  For such caches the free-list link is
+   kept in an extra word past the end of the object, so that
+   freeing does not clobber the constructed state.
+
+   Slabs that still have free objects sit on the cache's partial
+   list and full slabs on its full list.  When the last object of
+   a slab is freed the page is given back to the page allocator,
+   except that each cache keeps one empty slab in reserve so that
+   a single object being allocated and freed repeatedly does not
+   go to the page allocator every time. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Object cache. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Size requested by the creator. */
+	size_t stride;              /* Distance between objects. */
+	size_t link_ofs;            /* Offset of free-list link in object. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	kmem_ctor *ctor;            /* Constructor, or null. */
+	struct lock lock;           /* Protects everything below. */
+	struct list partial;        /* Slabs with some free objects. */
+	struct list full;           /* Slabs with no free objects. */
+	struct slab *spare;         /* Empty slab kept in reserve, or null. */
+	struct list_elem elem;      /* Element in cache_list. */
+
+	/* Statistics. */
+	size_t slab_cnt;            /* Slabs currently owned, incl. spare. */
+	size_t inuse_cnt;           /* Objects currently allocated. */
+	size_t peak_cnt;            /* Highest value of inuse_cnt. */
+	long long alloc_cnt;        /* # of successful allocations. */
+};
+
+/* Slab header, at the start of each slab's page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in partial or full list. */
+	size_t inuse_cnt;           /* Number of allocated objects. */
+	void *free;                 /* First free object, or null. */
+};
+
+/* Offset of the first object within a slab. */
+#define SLAB_HDR_SIZE ROUND_UP (sizeof (struct slab), sizeof (void *))
+
+/* All caches, for statistics. */
+static struct list cache_list;
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void **obj_link (struct kmem_cache *, void *);
+
+/* Initializes the slab allocator. */
+void
+kmem_init (void) {
+	list_init (&cache_list);
+}
+
+/* Creates and returns a cache for objects of SIZE bytes named
+   NAME, which must remain valid for the lifetime of the kernel.
+   If CTOR is non-null, it is run on each object when its slab is
+   created.  Panics if memory is not available, since caches are
+   created only at boot. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor *ctor) {
+	struct kmem_cache *c;
+
+	ASSERT (name != NULL);
+	ASSERT (size > 0);
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		PANIC ("kmem_cache_create: out of memory for cache %s", name);
+
+	c->name = name;
+	c->obj_size = size;
+	c->ctor = ctor;
+	if (ctor != NULL) {
+		c->link_ofs = ROUND_UP (size, sizeof (void *));
+		c->stride = c->link_ofs + sizeof (void *);
+	} else {
+		c->link_ofs = 0;
+		c->stride = ROUND_UP (size, sizeof (void *));
+	}
+	ASSERT (c->stride <= PGSIZE - SLAB_HDR_SIZE);
+	c->objs_per_slab = (PGSIZE - SLAB_HDR_SIZE) / c->stride;
+
+	lock_init (&c->lock);
+	list_init (&c->partial);
+	list_init (&c->full);
+	c->spare = NULL;
+	c->slab_cnt = 0;
+	c->inuse_cnt = 0;
+	c->peak_cnt = 0;
+	c->alloc_cnt = 0;
+	list_push_back (&cache_list, &c->elem);
+	return c;
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+	void *obj;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+	if (list_empty (&c->partial)) {
+		if (c->spare != NULL) {
+			s = c->spare;
+			c->spare = NULL;
+		} else {
+			s = slab_create (c);
+			if (s == NULL) {
+				lock_release (&c->lock);
+				return NULL;
+			}
+		}
+		list_push_front (&c->partial, &s->elem);
+	}
+
+	/* Take the first free object of the first partial slab. */
+	s = list_entry (list_front (&c->partial), struct slab, elem);
+	obj = s->free;
+	s->free = *obj_link (c, obj);
+	if (++s->inuse_cnt == c->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_back (&c->full, &s->elem);
+	}
+
+	c->alloc_cnt++;
+	if (++c->inuse_cnt > c->peak_cnt)
+		c->peak_cnt = c->inuse_cnt;
+	lock_release (&c->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  If C has a constructor, OBJ must be in its constructed
+   state.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+
+	ASSERT (c != NULL);
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (c, obj);
+
+	lock_acquire (&c->lock);
+	*obj_link (c, obj) = s->free;
+	s->free = obj;
+	c->inuse_cnt--;
+
+	/* A full slab becomes partial again. */
+	if (s->inuse_cnt-- == c->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_front (&c->partial, &s->elem);
+	}
+
+	/* An empty slab becomes the spare, or goes back to the page
+	   allocator if we already have one. */
+	if (s->inuse_cnt == 0) {
+		list_remove (&s->elem);
+		if (c->spare == NULL)
+			c->spare = s;
+		else {
+			c->slab_cnt--;
+			palloc_free_page (s);
+		}
+	}
+	lock_release (&c->lock);
+}
+
+/* Prints occupancy statistics for each cache that was used. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&cache_list); e != list_end (&cache_list);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+		size_t capacity = c->slab_cnt * c->objs_per_slab;
+
+		if (c->alloc_cnt == 0)
+			continue;
+		printf ("Slab %s: %zu bytes/object, %zu/%zu in use (%zu%%), "
+				"%zu peak, %zu slabs, %lld allocs\n",
+				c->name, c->obj_size, c->inuse_cnt, capacity,
+				capacity > 0 ? c->inuse_cnt * 100 / capacity : 0,
+				c->peak_cnt, c->slab_cnt, c->alloc_cnt);
+	}
+}
+
+/* Allocates a page from the page allocator, formats it as an
+   empty slab for cache C, and constructs its objects.  Returns
+   the slab, or a null pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c) {
+	struct slab *s;
+	uint8_t *obj;
+	size_t i;
+
+	s = palloc_get_page (0);
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = c;
+	s->inuse_cnt = 0;
+	s->free = NULL;
+
+	/* Thread the free list in address order. */
+	obj = (uint8_t *) s + SLAB_HDR_SIZE + (c->objs_per_slab - 1) * c->stride;
+	for (i = 0; i < c->objs_per_slab; i++, obj -= c->stride) {
+		if (c->ctor != NULL)
+			c->ctor (obj);
+		*obj_link (c, obj) = s->free;
+		s->free = obj;
+	}
+
+	c->slab_cnt++;
+	return s;
+}
+
+/* Returns the slab that OBJ, an object of cache C, is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid and belongs to C. */
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == c);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT ((pg_ofs (obj) - SLAB_HDR_SIZE) % c->stride == 0);
+
+	return s;
+}
+
+/* Returns the free-list link of OBJ, an object of cache C. */
+static void **
+obj_link (struct kmem_cache *c, void *obj) {
+	return (void **) ((uint8_t *) obj + c->link_ofs);
+}
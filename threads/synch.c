@@ -32,11 +32,12 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
-#define MAX_DEPTH 8
-
-void update(void);
-static void donate(void);
 bool sema_elem_func(const struct list_elem *a_, const struct list_elem *b_, void *aux UNUSED);
+static bool lock_spin (struct lock *);
+
+/* Maximum number of polls lock_acquire() makes while the holder
+   is running on another CPU, before giving up and sleeping. */
+#define LOCK_SPIN_LIMIT 1000
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -62,9 +63,15 @@ sema_init (struct semaphore *sema, unsigned value) {
    interrupt handler.  This function may be called with
    interrupts disabled, but if it sleeps then the next scheduled
    thread will probably turn interrupts back on. This is
-   sema_down function. */
+   sema_down function.
+
+   Waiters are kept in priority order; thread_set_effective_priority()
+   repositions a waiter whose priority changes while it sleeps.  If
+   the caller is acquiring a lock, the lock's holder receives a
+   donation before we block. */
 void
 sema_down (struct semaphore *sema) {
+	struct thread *cur = thread_current ();
 
 	ASSERT (sema != NULL);
 	ASSERT (!intr_context ());
@@ -72,7 +79,11 @@ sema_down (struct semaphore *sema) {
 	enum intr_level old_level;
 	old_level = intr_disable ();
 	while (sema->value == 0) {
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, list_higher_priority, NULL);
+		list_insert_ordered(&sema->waiters, &cur->elem, list_higher_priority, NULL);
+		cur->wait_on_sema = sema;
+		if (!thread_mlfqs && cur->wait_on_lock != NULL
+				&& cur->wait_on_lock->holder != NULL)
+			thread_refresh_priority (cur->wait_on_lock->holder);
 		thread_block ();
 	}
 	sema->value--;
@@ -117,10 +128,24 @@ sema_up (struct semaphore *sema) {
 	old_level = intr_disable ();
 
 	/* customed */
+	/* Under MLFQS, blocked waiters have not seen the recent_cpu
+	   decays since they blocked, so their order is stale.  Bring
+	   each one up to date first; a waiter whose priority changes
+	   is moved to its new place, which at worst visits it twice. */
+	if (thread_mlfqs) {
+		struct list_elem *e, *next;
+
+		for (e = list_begin (&sema->waiters); e != list_end (&sema->waiters);
+				e = next) {
+			next = list_next (e);
+			mlfqs_catch_up (list_entry (e, struct thread, elem));
+		}
+	}
 	if (!list_empty (&sema->waiters)) {
-		list_sort(&sema->waiters, list_higher_priority, NULL);
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-					struct thread, elem));
+		struct thread *t = list_entry (list_pop_front (&sema->waiters),
+				struct thread, elem);
+		t->wait_on_sema = NULL;
+		thread_unblock (t);
 	}
 	sema->value++;
 
@@ -165,6 +190,47 @@ sema_test_helper (void *sema_) {
 	}
 }
 
+/* Initializes spin lock SPIN as unheld. */
+void
+spinlock_init (struct spinlock *spin) {
+	ASSERT (spin != NULL);
+
+	spin->locked = 0;
+	spin->old_level = INTR_OFF;
+}
+
+/* Acquires SPIN, busy-waiting until it is free.  Interrupts are
+   disabled on return and restored by spinlock_release(), so that
+   an interrupt handler on this CPU cannot deadlock against us.
+   Spin locks may be nested but must be released in reverse order
+   of acquisition. */
+void
+spinlock_acquire (struct spinlock *spin) {
+	enum intr_level old_level;
+
+	ASSERT (spin != NULL);
+
+	old_level = intr_disable ();
+	while (__atomic_exchange_n (&spin->locked, 1, __ATOMIC_ACQUIRE) != 0)
+		while (spin->locked)
+			asm volatile ("pause" : : : "memory");
+	spin->old_level = old_level;
+}
+
+/* Releases SPIN, which must be held by this CPU, and restores
+   the interrupt level saved by spinlock_acquire(). */
+void
+spinlock_release (struct spinlock *spin) {
+	enum intr_level old_level;
+
+	ASSERT (spin != NULL);
+	ASSERT (spin->locked);
+
+	old_level = spin->old_level;
+	__atomic_store_n (&spin->locked, 0, __ATOMIC_RELEASE);
+	intr_set_level (old_level);
+}
+
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -186,6 +252,10 @@ lock_init (struct lock *lock) {
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
+	lock->acquire_cnt = 0;
+	lock->contend_cnt = 0;
+	lock->spin_cnt = 0;
+	lock->block_cnt = 0;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -195,29 +265,46 @@ lock_init (struct lock *lock) {
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
-   we need to sleep. */
+   we need to sleep.
+
+   While we wait, our priority is donated to the holder, and from
+   there along the chain of locks the holder is itself waiting
+   for.  Once we own the lock we inherit the priority of its
+   remaining waiters.
+
+   Most kernel locks guard only a few instructions, so if the
+   holder is running on another CPU we first spin briefly in the
+   hope that it releases the lock soon, and only sleep if it does
+   not or if the holder is itself off the CPU. */
 void
 lock_acquire (struct lock *lock) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
 	/* customed */
-	if (lock->holder != NULL) {
-		thread_current()->wait_on_lock = lock;
-		
-		if (!thread_mlfqs) {
-			list_insert_ordered(&lock->holder->donations, &thread_current()->d_elem
-								, list_higher_priority, NULL);
-			donate();
+	old_level = intr_disable ();
+	if (!sema_try_down (&lock->semaphore)) {
+		lock->contend_cnt++;
+		if (lock_spin (lock))
+			lock->spin_cnt++;
+		else {
+			lock->block_cnt++;
+			cur->wait_on_lock = lock;
+			sema_down (&lock->semaphore);
+			cur->wait_on_lock = NULL;
 		}
 	}
 
-	sema_down (&lock->semaphore);
-
-	thread_current()->wait_on_lock = NULL;
-	/* customed */
-	lock->holder = thread_current ();
+	lock->acquire_cnt++;
+	lock->holder = cur;
+	list_push_back (&cur->held_locks, &lock->elem);
+	if (!thread_mlfqs)
+		thread_refresh_priority (cur);
+	intr_set_level (old_level);
 }
 
 
@@ -234,9 +321,19 @@ lock_try_acquire (struct lock *lock) {
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	enum intr_level old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
-	if (success)
-		lock->holder = thread_current ();
+	if (success) {
+		struct thread *cur = thread_current ();
+
+		lock->acquire_cnt++;
+		lock->holder = cur;
+		list_push_back (&cur->held_locks, &lock->elem);
+		/* Threads already waiting on LOCK now donate to us. */
+		if (!thread_mlfqs)
+			thread_refresh_priority (cur);
+	}
+	intr_set_level (old_level);
 	return success;
 }
 
@@ -252,27 +349,49 @@ lock_release (struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	/* customed */
-
+	/* Dropping LOCK drops the donations that arrived through it. */
+	enum intr_level old_level = intr_disable ();
+	list_remove (&lock->elem);
+	lock->holder = NULL;
 	if (!thread_mlfqs)
-	{
-		struct list_elem *e;
-		enum intr_level old_level = intr_disable();
-		struct list *doners = &thread_current()->donations;
-		for (e = list_begin(doners); e != list_end(doners); e = list_next(e))
-		{
-			struct thread *t = list_entry(e, struct thread, d_elem);
-			if (t->wait_on_lock == lock) {
-				list_remove(&t->d_elem);
-			}
-		}
-		update();
-		intr_set_level(old_level);
-	}
+		thread_refresh_priority (thread_current ());
 
-	/* customed */
-
-	lock->holder = NULL;
 	sema_up (&lock->semaphore);
+	intr_set_level (old_level);
+}
+
+/* Busy-waits for LOCK while its holder is running on another
+   CPU, for at most LOCK_SPIN_LIMIT polls.  Returns true if we
+   acquired LOCK's semaphore, false if the caller should sleep. */
+static bool
+lock_spin (struct lock *lock) {
+	int i;
+
+	for (i = 0; i < LOCK_SPIN_LIMIT; i++) {
+		struct thread *holder = lock->holder;
+
+		/* A holder that is not running on some CPU cannot release
+		   the lock until it is scheduled again.  On a uniprocessor
+		   the holder is never running, since we are. */
+		if (holder != NULL
+				&& (holder->status != THREAD_RUNNING || holder == thread_current ()))
+			return false;
+		if (sema_try_down (&lock->semaphore))
+			return true;
+		asm volatile ("pause" : : : "memory");
+	}
+	return false;
+}
+
+/* Prints LOCK's contention statistics under NAME, if it was ever
+   contended. */
+void
+lock_print_stats (const struct lock *lock, const char *name) {
+	if (lock->contend_cnt == 0)
+		return;
+	printf ("Lock %s: %lld acquires, %lld contended, %lld won by spinning, "
+			"%lld slept\n", name, lock->acquire_cnt, lock->contend_cnt,
+			lock->spin_cnt, lock->block_cnt);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -360,6 +479,17 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED) {
 	/* customed */
 	enum intr_level old_level = intr_disable();
 
+	/* Under MLFQS, re-sort waiters whose priorities went stale
+	   while they were blocked, as sema_up() does. */
+	if (thread_mlfqs) {
+		struct list_elem *e;
+
+		for (e = list_begin (&cond->waiters); e != list_end (&cond->waiters);
+				e = list_next (e))
+			mlfqs_catch_up (list_entry (e, struct semaphore_elem, elem)->holder);
+		list_sort (&cond->waiters, sema_elem_func, NULL);
+	}
+
 	/* customed */
 	if (!list_empty (&cond->waiters)) {
 		sema_up (&list_entry (list_pop_front (&cond->waiters),
@@ -384,49 +514,99 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 		cond_signal (cond, lock);
 }
 
-/* customed */
-bool
-sema_elem_func(const struct list_elem *a_, const struct list_elem *b_, void *aux UNUSED){
-	const struct thread *a = list_entry(a_, struct semaphore_elem, elem)->holder;
-	const struct thread *b = list_entry(b_, struct semaphore_elem, elem)->holder;
+/* Initializes RWLOCK, unheld. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
 
-	return a->priority > b->priority;
+	lock_init (&rw->lock);
+	rw->readers = 0;
+	rw->writer_waiting = false;
+	sema_init (&rw->drained, 0);
 }
 
-void update()
-{
-	thread_current()->priority = thread_current()->original_priority;
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.  Readers do not nest: a thread that already
+   holds RW in either mode must not acquire it again, which is why
+   RW must not be held across an access to user memory (see
+   synch.h).
 
-	if (!list_empty(&thread_current()->donations)) 
-	{
-		struct thread *max_t = list_entry(list_front(&thread_current()->donations), struct thread, d_elem);
+   Entering through RW's lock queues the reader behind any writer
+   in priority order and donates its priority to the writer. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	enum intr_level old_level;
 
-		if (thread_current()->priority < max_t->priority) {
-			thread_current()->priority = max_t->priority;
-			return;
-		}
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	rw->readers++;
+	intr_set_level (old_level);
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   last reader out wakes a writer waiting for readers to drain. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0 && rw->writer_waiting) {
+		rw->writer_waiting = false;
+		sema_up (&rw->drained);
 	}
+	intr_set_level (old_level);
 }
 
-static void donate()
-{
-	struct thread *doner = thread_current();
-	int cnt = 1;
-	// for (size_t i = 0; i < 8; i++)
-	{
-		while (doner->wait_on_lock != NULL)
-		{
-			if (cnt++ >= MAX_DEPTH) return;
-			struct thread *donatee = doner->wait_on_lock->holder;
-
-			if (donatee->priority < doner->priority) {
-				donatee->priority = doner->priority;
-				doner = donatee;
-			}
-			else {
-				break;
-			}
-		}
+/* Acquires RW for writing.  Taking RW's lock first stops new
+   readers from entering, then we sleep until the readers already
+   inside have left.  Readers are not tracked individually, so
+   our priority is not donated to them while we wait. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	while (rw->readers > 0) {
+		rw->writer_waiting = true;
+		sema_down (&rw->drained);
 	}
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rw->readers == 0);
+
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return lock_held_by_current_thread (&rw->lock);
 }
-/* customed */
\ No newline at end of file
+
+/* customed */
+bool
+sema_elem_func(const struct list_elem *a_, const struct list_elem *b_, void *aux UNUSED){
+	const struct thread *a = list_entry(a_, struct semaphore_elem, elem)->holder;
+	const struct thread *b = list_entry(b_, struct semaphore_elem, elem)->holder;
+
+	return a->priority > b->priority;
+}
+/* customed */
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
@@ -27,23 +28,76 @@
 #define THREAD_BASIC 0xd42df210
 
 /* customed */
-static struct list sleep_list;
-// static int64_t global_min_ttw = INT64_MAX; /* global minimum time to wakeup tick */
+/* Sleeping threads, kept as a binary min-heap keyed on
+   time_to_wakeup.  sleep_heap[0] is always the next thread to
+   wake, so the timer interrupt can compare the current tick
+   against it and skip the wakeup pass when nothing is due.  The
+   heap starts in a small static array and is moved to larger
+   page-backed storage by thread_sleep() when it fills up. */
+#define SLEEP_HEAP_INIT_CAP 64
+static struct thread *sleep_heap_init[SLEEP_HEAP_INIT_CAP];
+static struct thread **sleep_heap;
+static size_t sleep_heap_cnt;   /* # of sleeping threads. */
+static size_t sleep_heap_cap;   /* Capacity of sleep_heap, in entries. */
+static size_t sleep_heap_pages; /* Pages backing sleep_heap, 0 if static. */
 
 /* advanced */
 static fp_float load_avg = 0;
 struct list all_thread_list;
+
+/* Incremental MLFQS bookkeeping.
+
+   Threads whose recent_cpu or nice changed since their priority
+   was last computed sit on mlfqs_dirty_list, and the 4-tick
+   priority pass only visits those.  Between two once-per-second
+   decays that is just the threads that actually ran.
+
+   The per-second decay is applied eagerly only to running and
+   ready threads, whose priorities drive scheduling.  Blocked
+   threads record in cpu_epoch how many decays they have seen and
+   catch up from decay_history[] when they are unblocked.  Every
+   MLFQS_HISTORY seconds a full sweep brings every thread up to
+   date so the history ring never wraps past a blocked thread. */
+#define MLFQS_HISTORY 64
+static struct list mlfqs_dirty_list;
+static int64_t mlfqs_epoch;                     /* # of decays so far. */
+static fp_float decay_history[MLFQS_HISTORY];   /* Decay per epoch. */
+static void mlfqs_mark_dirty (struct thread *);
+static bool mlfqs_sync (struct thread *);
 /* advanced */
 
 void preemption(void);
-static bool time_to_wakeup_less (const struct list_elem *a_, const struct list_elem *b_, void *aux UNUSED);
-
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+static bool sleep_heap_grow (void);
+static void sleep_heap_push (struct thread *);
+static struct thread *sleep_heap_pop (void);
+
+/* Per-CPU scheduler state.
+
+   Each CPU owns a run queue of the processes in THREAD_READY state
+   that will run on it, that is, processes that are ready to run but
+   not actually running.  There is one FIFO queue per priority level,
+   and bit N of ready_bitmap is set iff ready_queues[N] is non-empty,
+   so the highest runnable level is found with a single bit scan.
+   The run queue is protected by rq_lock, so that other CPUs may
+   enqueue onto it. */
+struct cpu {
+	int id;                         /* Index into cpus[]. */
+	struct spinlock rq_lock;        /* Protects the run queue. */
+	struct list ready_queues[PRI_MAX + 1];
+	uint64_t ready_bitmap;
+	size_t ready_cnt;               /* # of threads in all ready_queues. */
+
+	struct thread *curr;            /* Thread running on this CPU. */
+	struct thread *idle_thread;     /* This CPU's idle thread. */
+	unsigned thread_ticks;          /* # of timer ticks since last yield. */
+
+	/* Statistics. */
+	long long idle_ticks;           /* # of timer ticks spent idle. */
+	long long kernel_ticks;         /* # of timer ticks in kernel threads. */
+	long long user_ticks;           /* # of timer ticks in user programs. */
+};
+
+static struct cpu cpus[NCPU];
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -54,14 +108,8 @@ static struct lock tid_lock;
 /* Thread destruction requests */
 static struct list destruction_req;
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
@@ -76,10 +124,18 @@ static void init_thread (struct thread *, const char *name, int priority);
 static void do_schedule(int status);
 static void schedule (void);
 static tid_t allocate_tid (void);
+static void cpu_init (struct cpu *, int id);
+static struct cpu *this_cpu (void);
+static bool is_idle (const struct thread *);
+static void ready_queue_push (struct cpu *, struct thread *);
+static void ready_queue_remove (struct thread *);
+static struct thread *ready_queue_pop (struct cpu *);
+static int ready_queue_max_priority (const struct cpu *);
+static int donated_priority (struct thread *);
+static void reap_dying_threads (void);
 /* customed */
-void thread_sleep(int64_t tick);
+bool thread_sleep(int64_t tick);
 void thread_wakeup(int64_t tick);
-int64_t get_thread_ttw_tick(void);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -125,18 +181,26 @@ thread_init (void) {
 
 	/* Init the globla thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list); 
+	for (int i = 0; i < NCPU; i++)
+		cpu_init (&cpus[i], i);
 	list_init (&destruction_req);
 	/* customed */
-	list_init (&sleep_list);
+	sleep_heap = sleep_heap_init;
+	sleep_heap_cnt = 0;
+	sleep_heap_cap = SLEEP_HEAP_INIT_CAP;
+	sleep_heap_pages = 0;
 
 	/* advanced */
 	list_init (&all_thread_list);
+	list_init (&mlfqs_dirty_list);
+	mlfqs_epoch = 0;
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
+	initial_thread->cpu = 0;
+	cpus[0].curr = initial_thread;
 	initial_thread->tid = allocate_tid ();
 	list_push_back(&all_thread_list, &initial_thread->adv_elem);
 }
@@ -166,26 +230,35 @@ thread_start (void) {
 void
 thread_tick (void) {
 	struct thread *t = thread_current ();
+	struct cpu *c = this_cpu ();
 	/* Update statistics. */
-	if (t == idle_thread)
-		idle_ticks++;
+	if (t == c->idle_thread)
+		c->idle_ticks++;
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
-		user_ticks++;
+		c->user_ticks++;
 #endif
 	else
-		kernel_ticks++;
+		c->kernel_ticks++;
 
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (++c->thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
+	long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+
+	for (int i = 0; i < NCPU; i++) {
+		idle_ticks += cpus[i].idle_ticks;
+		kernel_ticks += cpus[i].kernel_ticks;
+		user_ticks += cpus[i].user_ticks;
+	}
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	lock_print_stats (&tid_lock, "tid");
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -211,6 +284,8 @@ thread_create (const char *name, int priority,
 
 	ASSERT (function != NULL);
 
+	reap_dying_threads ();
+
 	/* Allocate thread. */
 	t = palloc_get_page (PAL_ZERO);						// (4KB) single page
 	if (t == NULL)
@@ -219,6 +294,7 @@ thread_create (const char *name, int priority,
 	/* Initialize thread. */
 	init_thread (t, name, priority);
 	tid = t->tid = allocate_tid ();
+	t->cpu = this_cpu ()->id;
 
 	/* Call the kernel_thread if it scheduled.
 	 * Note) rdi is 1st argument, and rsi is 2nd argument. */
@@ -233,6 +309,11 @@ thread_create (const char *name, int priority,
 	
 	/* advanced */
 	list_push_back(&all_thread_list, &t->adv_elem);
+	if (thread_mlfqs) {
+		enum intr_level old_level = intr_disable ();
+		mlfqs_mark_dirty (t);
+		intr_set_level (old_level);
+	}
 
 	/* Project2 */
 	list_push_back(&thread_current()->child_list, &t->child_elem);
@@ -284,9 +365,11 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	/* customed */
-	// list_push_back (&ready_list, &t->elem);
-	list_insert_ordered(&ready_list, &t->elem, list_higher_priority, NULL);
+	/* Catch up on the decays missed while blocked, so that T
+	   lands on the level matching its current recent_cpu. */
+	if (thread_mlfqs)
+		mlfqs_catch_up (t);
+	ready_queue_push (&cpus[t->cpu], t);
 	t->status = THREAD_READY;
 	intr_set_level (old_level);
 }
@@ -327,6 +410,8 @@ void
 thread_exit (void) {
 	ASSERT (!intr_context ());
 
+	reap_dying_threads ();
+
 #ifdef USERPROG
 	process_exit ();
 #endif
@@ -338,6 +423,8 @@ thread_exit (void) {
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
 	list_remove(&thread_current()->adv_elem);
+	if (thread_current()->mlfqs_dirty)
+		list_remove(&thread_current()->dirty_elem);
 	
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
@@ -353,11 +440,8 @@ thread_yield (void) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	/* customed */
-	if (curr != idle_thread)
-		list_insert_ordered(&ready_list, &curr->elem, list_higher_priority, NULL);
-		// list_push_back (&ready_list, &curr->elem);
-	/* customed  */
+	if (!is_idle (curr))
+		ready_queue_push (this_cpu (), curr);
 	do_schedule (THREAD_READY);		// 컨텍스트 스위치를 호출한다. 
 	intr_set_level (old_level);
 }
@@ -366,12 +450,12 @@ thread_yield (void) {
 void
 thread_set_priority (int new_priority) {
 	/* customed */
-	thread_current ()->priority = new_priority;
 	if (!thread_mlfqs) {
 		thread_current ()->original_priority = new_priority; // priority를 변경하는 것은 도네이션 받은 것을 변경하는 것일 수도 있음. -> original priority 를 수정해야함.
-		update();
+		thread_refresh_priority (thread_current ());
 		preemption();
-	}
+	} else
+		thread_current ()->priority = new_priority;
 	/* customed */
 }
 
@@ -386,8 +470,11 @@ thread_get_priority (void) {
 // thread nice 설정
 void
 thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
+	enum intr_level old_level = intr_disable ();
 	thread_current()->nice = nice;
+	if (thread_mlfqs)
+		mlfqs_mark_dirty (thread_current ());
+	intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
@@ -434,7 +521,7 @@ static void
 idle (void *idle_started_ UNUSED) {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current ();
+	this_cpu ()->idle_thread = thread_current ();
 	sema_up (idle_started);
 
 	for (;;) {
@@ -442,6 +529,16 @@ idle (void *idle_started_ UNUSED) {
 		intr_disable ();
 		thread_block ();
 
+		/* Nobody else wants to run, so zero free pages ahead of
+		   PAL_ZERO requests until somebody does.  If a thread
+		   became ready meanwhile, go run it instead of halting. */
+		intr_enable ();
+		while (this_cpu ()->ready_cnt == 0 && palloc_zero_idle ())
+			continue;
+		intr_disable ();
+		if (this_cpu ()->ready_cnt > 0)
+			continue;
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -488,7 +585,7 @@ init_thread (struct thread *t, const char *name, int priority) {
 	/* customed */
 	t->original_priority = priority;
 	t->time_to_wakeup = 0;
-	list_init(&t->donations);
+	list_init(&t->held_locks);
 
 	/* process init */
 	t->terminated = false;
@@ -500,6 +597,7 @@ init_thread (struct thread *t, const char *name, int priority) {
 	sema_init(&t->sema_load, 0);
 	sema_init(&t->sema_wait, 0);
 	t->wait_on_lock = NULL;
+	t->wait_on_sema = NULL;
 	
 	/* fdt init */
 	// t->nex_fd = 2;
@@ -510,6 +608,8 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->exit_code = 0;
 	t->nice = 0;
 	t->recent_cpu = 0;
+	t->cpu_epoch = mlfqs_epoch;
+	t->mlfqs_dirty = false;
 
 	t->magic = THREAD_MAGIC;
 }
@@ -521,10 +621,171 @@ init_thread (struct thread *t, const char *name, int priority) {
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct cpu *c = this_cpu ();
+	struct thread *next = ready_queue_pop (c);
+
+	return next != NULL ? next : c->idle_thread;
+}
+
+/* Initializes per-CPU state C for the CPU numbered ID. */
+static void
+cpu_init (struct cpu *c, int id) {
+	memset (c, 0, sizeof *c);
+	c->id = id;
+	spinlock_init (&c->rq_lock);
+	for (int i = PRI_MIN; i <= PRI_MAX; i++)
+		list_init (&c->ready_queues[i]);
+}
+
+/* Returns the per-CPU state of the CPU we are running on.
+   Every thread records the CPU it was last scheduled on, and the
+   running thread's record is current by construction. */
+static struct cpu *
+this_cpu (void) {
+	return &cpus[running_thread ()->cpu];
+}
+
+/* Returns true if T is the idle thread of the CPU it belongs to. */
+static bool
+is_idle (const struct thread *t) {
+	return t == cpus[t->cpu].idle_thread;
+}
+
+/* Appends T to the tail of C's ready queue for its priority.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct cpu *c, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	spinlock_acquire (&c->rq_lock);
+	t->cpu = c->id;
+	list_push_back (&c->ready_queues[t->priority], &t->elem);
+	c->ready_bitmap |= 1ULL << t->priority;
+	c->ready_cnt++;
+	spinlock_release (&c->rq_lock);
+}
+
+/* Removes ready thread T from the ready queue it is on.
+   Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t) {
+	struct cpu *c = &cpus[t->cpu];
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t->status == THREAD_READY);
+
+	spinlock_acquire (&c->rq_lock);
+	list_remove (&t->elem);
+	if (list_empty (&c->ready_queues[t->priority]))
+		c->ready_bitmap &= ~(1ULL << t->priority);
+	c->ready_cnt--;
+	spinlock_release (&c->rq_lock);
+}
+
+/* Removes and returns the oldest thread of the highest non-empty
+   priority level of C's run queue, or a null pointer if no thread
+   is ready on C. */
+static struct thread *
+ready_queue_pop (struct cpu *c) {
+	struct thread *t = NULL;
+	int pri;
+
+	spinlock_acquire (&c->rq_lock);
+	pri = ready_queue_max_priority (c);
+	if (pri >= PRI_MIN) {
+		t = list_entry (list_pop_front (&c->ready_queues[pri]),
+				struct thread, elem);
+		if (list_empty (&c->ready_queues[pri]))
+			c->ready_bitmap &= ~(1ULL << pri);
+		c->ready_cnt--;
+	}
+	spinlock_release (&c->rq_lock);
+	return t;
+}
+
+/* Returns the priority of the highest non-empty level of C's
+   ready queue, or -1 if no thread is ready on C. */
+static int
+ready_queue_max_priority (const struct cpu *c) {
+	if (c->ready_bitmap == 0)
+		return -1;
+	return 63 - __builtin_clzll (c->ready_bitmap);
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is sitting in
+   the ready queue it is moved to the tail of its new level, and if
+   it is blocked on a semaphore it is moved to its new place in the
+   semaphore's waiter list, so that priority donation and the MLFQS
+   recomputation both keep every queue ordered through this single
+   entry point.
+
+   If T is waiting for a lock, the change is then propagated along
+   the wait-for chain: the lock's holder has its donated priority
+   recomputed, and so on, until some holder's priority does not
+   change.  The walk has no depth limit. */
+void
+thread_set_effective_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	while (t->priority != priority) {
+		if (t->status == THREAD_READY) {
+			ready_queue_remove (t);
+			t->priority = priority;
+			ready_queue_push (&cpus[t->cpu], t);
+		} else if (t->status == THREAD_BLOCKED && t->wait_on_sema != NULL) {
+			list_remove (&t->elem);
+			t->priority = priority;
+			list_insert_ordered (&t->wait_on_sema->waiters, &t->elem,
+					list_higher_priority, NULL);
+		} else
+			t->priority = priority;
+
+		if (thread_mlfqs || t->wait_on_lock == NULL
+				|| t->wait_on_lock->holder == NULL)
+			break;
+		t = t->wait_on_lock->holder;
+		priority = donated_priority (t);
+	}
+	intr_set_level (old_level);
+}
+
+/* Recomputes T's effective priority from its own priority and the
+   donations it receives through the locks it holds. */
+void
+thread_refresh_priority (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	thread_set_effective_priority (t, donated_priority (t));
+	intr_set_level (old_level);
+}
+
+/* Returns the higher of T's own priority and the priority of the
+   highest-priority waiter on any lock T holds.  Lock waiter lists
+   are kept ordered, so this costs O(locks held by T). */
+static int
+donated_priority (struct thread *t) {
+	int priority = t->original_priority;
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+			e = list_next (e)) {
+		struct lock *l = list_entry (e, struct lock, elem);
+		struct list *waiters = &l->semaphore.waiters;
+
+		if (!list_empty (waiters)) {
+			const struct thread *w =
+				list_entry (list_front (waiters), struct thread, elem);
+			if (w->priority > priority)
+				priority = w->priority;
+		}
+	}
+	return priority;
 }
 
 /* Use iretq to launch the thread */
@@ -632,15 +893,34 @@ static void
 do_schedule(int status) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (thread_current()->status == THREAD_RUNNING);
-	while (!list_empty (&destruction_req)) {
-		struct thread *victim =
-			list_entry (list_pop_front (&destruction_req), struct thread, elem);
-		palloc_free_page(victim);
-	}
 	thread_current ()->status = status;
 	schedule ();
 }
 
+/* Frees the pages of threads that died since the last call.
+   do_schedule() cannot do this itself: palloc_free_page() takes
+   the pool lock, which may sleep, and the scheduler must not
+   sleep.  Called with interrupts on from thread_create() and
+   thread_exit(); does nothing with interrupts off. */
+static void
+reap_dying_threads (void) {
+	if (intr_get_level () == INTR_OFF)
+		return;
+
+	for (;;) {
+		struct thread *victim = NULL;
+		enum intr_level old_level = intr_disable ();
+
+		if (!list_empty (&destruction_req))
+			victim = list_entry (list_pop_front (&destruction_req),
+					struct thread, elem);
+		intr_set_level (old_level);
+		if (victim == NULL)
+			break;
+		palloc_free_page (victim);
+	}
+}
+
 static void
 schedule (void) {
 	struct thread *curr = running_thread ();
@@ -653,7 +933,8 @@ schedule (void) {
 	next->status = THREAD_RUNNING;
 
 	/* Start new time slice. */
-	thread_ticks = 0;
+	this_cpu ()->thread_ticks = 0;
+	this_cpu ()->curr = next;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -666,8 +947,7 @@ schedule (void) {
 		   pull out the rug under itself.
 		   We just queuing the page free reqeust here because the page is
 		   currently used by the stack.
-		   The real destruction logic will be called at the beginning of the
-		   schedule(). */
+		   The page is freed later by reap_dying_threads(). */
 		if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
 			ASSERT (curr != next);
 			list_push_back (&destruction_req, &curr->elem);
@@ -693,53 +973,130 @@ allocate_tid (void) {
 }
 
 /* customed */
-void
+/* Puts the running thread to sleep until timer tick TICK.
+   Returns false, without sleeping, if the sleep heap is full and
+   there is no memory to grow it. */
+bool
 thread_sleep(int64_t tick) {
 	struct thread* cur = thread_current();
 	enum intr_level old_level;
 
-  ASSERT (!intr_context ());
-	if (cur != idle_thread) {
+	ASSERT (!intr_context ());
+	if (!is_idle (cur)) {
 		cur->time_to_wakeup = tick;
 		old_level = intr_disable();
-		list_insert_ordered(&sleep_list, &cur->elem, time_to_wakeup_less, NULL);
+		while (sleep_heap_cnt == sleep_heap_cap) {
+			intr_set_level(old_level);
+			if (!sleep_heap_grow())
+				return false;
+			old_level = intr_disable();
+		}
+		sleep_heap_push(cur);
 		thread_block();
 		intr_set_level(old_level);
 	}
+	return true;
 }
 
+/* Wakes every sleeping thread whose time_to_wakeup is at or
+   before TICK.  Costs O(log n) per woken thread. */
 void
 thread_wakeup(int64_t tick) {
-	// sleep_list --- a thread ---> ready_list
+	enum intr_level old_level = intr_disable();
+	while (sleep_heap_cnt > 0 && sleep_heap[0]->time_to_wakeup <= tick)
+		thread_unblock(sleep_heap_pop());
+	intr_set_level(old_level);
+}
+
+/* Returns the tick at which the earliest sleeping thread must be
+   woken, or INT64_MAX if no thread is sleeping. */
+int64_t
+get_thread_ttw_tick(void) {
+	return sleep_heap_cnt > 0 ? sleep_heap[0]->time_to_wakeup : INT64_MAX;
+}
+
+/* Doubles the capacity of sleep_heap.  Must be called with
+   interrupts on, since it allocates.  Returns false if there are
+   not enough free pages. */
+static bool
+sleep_heap_grow(void) {
+	size_t old_pages = sleep_heap_pages;
+	size_t new_pages = old_pages == 0
+		? DIV_ROUND_UP(2 * sleep_heap_cap * sizeof *sleep_heap, PGSIZE)
+		: 2 * old_pages;
+	struct thread **new_heap = palloc_get_multiple(0, new_pages);
+	struct thread **old_heap;
 	enum intr_level old_level;
-	struct list_elem *e = list_begin(&sleep_list);
-	while (e != list_end(&sleep_list))
-	{
-		struct thread *t = list_entry(e, struct thread, elem);
 
-		if (t->time_to_wakeup <= tick) {
-			old_level = intr_disable();
-			list_pop_front(&sleep_list);
-			intr_set_level(old_level);
-			thread_unblock(t);
-			if (!list_empty(&sleep_list))
-				e = list_front(&sleep_list);
-			else
-				break;
-		} else {
+	if (new_heap == NULL)
+		return false;
+
+	old_level = intr_disable();
+	if (sleep_heap_pages >= new_pages) {
+		/* Another thread grew the heap while we were allocating. */
+		intr_set_level(old_level);
+		palloc_free_multiple(new_heap, new_pages);
+		return true;
+	}
+	old_heap = sleep_heap;
+	old_pages = sleep_heap_pages;
+	memcpy(new_heap, old_heap, sleep_heap_cnt * sizeof *sleep_heap);
+	sleep_heap = new_heap;
+	sleep_heap_cap = new_pages * PGSIZE / sizeof *sleep_heap;
+	sleep_heap_pages = new_pages;
+	intr_set_level(old_level);
+
+	if (old_pages != 0)
+		palloc_free_multiple(old_heap, old_pages);
+	return true;
+}
+
+/* Inserts T into sleep_heap, sifting it up to its place.
+   Interrupts must be off and the heap must have room. */
+static void
+sleep_heap_push(struct thread *t) {
+	size_t i = sleep_heap_cnt++;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (sleep_heap_cnt <= sleep_heap_cap);
+
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (sleep_heap[parent]->time_to_wakeup <= t->time_to_wakeup)
 			break;
-		}
+		sleep_heap[i] = sleep_heap[parent];
+		i = parent;
 	}
+	sleep_heap[i] = t;
 }
 
-static bool
-time_to_wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
-            void *aux UNUSED) 
-{
-  const struct thread *a = list_entry (a_, struct thread, elem);
-  const struct thread *b = list_entry (b_, struct thread, elem);
-  
-  return a->time_to_wakeup < b->time_to_wakeup;
+/* Removes and returns the thread with the smallest
+   time_to_wakeup.  Interrupts must be off and the heap must not
+   be empty. */
+static struct thread *
+sleep_heap_pop(void) {
+	struct thread *min, *last;
+	size_t i = 0;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (sleep_heap_cnt > 0);
+
+	min = sleep_heap[0];
+	last = sleep_heap[--sleep_heap_cnt];
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= sleep_heap_cnt)
+			break;
+		if (child + 1 < sleep_heap_cnt
+				&& sleep_heap[child + 1]->time_to_wakeup < sleep_heap[child]->time_to_wakeup)
+			child++;
+		if (last->time_to_wakeup <= sleep_heap[child]->time_to_wakeup)
+			break;
+		sleep_heap[i] = sleep_heap[child];
+		i = child;
+	}
+	sleep_heap[i] = last;
+	return min;
 }
 
 bool
@@ -755,11 +1112,9 @@ list_higher_priority (const struct list_elem *a_, const struct list_elem *b_,
 void preemption()
 {
 	enum intr_level old_level = intr_disable();
-	// list_sort(&ready_list, list_higher_priority, NULL);
 
 	struct thread *cur = thread_current();
-	if (!list_empty(&ready_list) && cur->priority < list_entry(list_front(&ready_list)
-														, struct thread, elem)->priority)
+	if (cur->priority < ready_queue_max_priority(this_cpu()))
 	{
 		thread_yield();
 	}
@@ -770,10 +1125,12 @@ void preemption()
 /* advanced */
 void calculate_load_avg()
 {
-    int ready_threads = list_size(&ready_list);
-    if (thread_current() != idle_thread)
+    int ready_threads = 0;
+    for (int i = 0; i < NCPU; i++)
     {
-        ready_threads += 1;
+        ready_threads += cpus[i].ready_cnt;
+        if (cpus[i].curr != NULL && cpus[i].curr != cpus[i].idle_thread)
+            ready_threads += 1;
     }
     load_avg = fp_add(fp_div2(fp_multi2(load_avg, 59), 60), fp_div2(itofp(ready_threads), 60));
 	// load_avg = fp_add(fp_multi(fp_div2(itofp(59), 60), load_avg), fp_multi2(fp_div2(itofp(1), 60), ready_threads));
@@ -781,51 +1138,139 @@ void calculate_load_avg()
 
 void calculate_priority(struct thread *t)
 {
-    if (t != idle_thread)
+    if (!is_idle(t))
     {
-        t->priority = PRI_MAX - fptoi_r(fp_add2(fp_div2(t->recent_cpu, 4), (t->nice * 2)));
+        int priority = PRI_MAX - fptoi_r(fp_add2(fp_div2(t->recent_cpu, 4), (t->nice * 2)));
+        if (priority < PRI_MIN)
+            priority = PRI_MIN;
+        else if (priority > PRI_MAX)
+            priority = PRI_MAX;
+        thread_set_effective_priority(t, priority);
     }
 }
 
+/* Applies the once-per-second recent_cpu decay.  Only running
+   and ready threads are decayed here; blocked threads catch up in
+   mlfqs_sync() when they become ready again. */
 void recalculate_recent_cpu()
 {
     struct list_elem *e;
-    for (e = list_begin(&all_thread_list); e != list_end(&all_thread_list); e = list_next(e))
+    int pri;
+
+    decay_history[mlfqs_epoch % MLFQS_HISTORY] =
+        fp_div(fp_multi2(load_avg, 2), fp_add2(fp_multi2(load_avg, 2), 1));
+    mlfqs_epoch++;
+
+    if (mlfqs_epoch % MLFQS_HISTORY == 0)
     {
-        struct thread *t = list_entry(e, struct thread, adv_elem);
-        calculate_recent_cpu(t);
+        /* Bring blocked threads up to date before their oldest
+           pending decay is overwritten in decay_history. */
+        for (e = list_begin(&all_thread_list); e != list_end(&all_thread_list); e = list_next(e))
+        {
+            struct thread *t = list_entry(e, struct thread, adv_elem);
+            if (mlfqs_sync(t))
+                mlfqs_mark_dirty(t);
+        }
+        return;
+    }
+
+    for (int i = 0; i < NCPU; i++)
+    {
+        struct cpu *c = &cpus[i];
+
+        spinlock_acquire(&c->rq_lock);
+        if (c->curr != NULL && mlfqs_sync(c->curr))
+            mlfqs_mark_dirty(c->curr);
+        for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+        {
+            if ((c->ready_bitmap & (1ULL << pri)) == 0)
+                continue;
+            for (e = list_begin(&c->ready_queues[pri]); e != list_end(&c->ready_queues[pri]); e = list_next(e))
+            {
+                struct thread *t = list_entry(e, struct thread, elem);
+                if (mlfqs_sync(t))
+                    mlfqs_mark_dirty(t);
+            }
+        }
+        spinlock_release(&c->rq_lock);
     }
 }
 
+/* Decays T's recent_cpu by one second's worth. */
 void calculate_recent_cpu(struct thread *t)
 {
-    if (t != idle_thread)
+    if (!is_idle(t))
     {
         fp_float decay = fp_div(fp_multi2(load_avg, 2), fp_add2(fp_multi2(load_avg, 2), 1));
         t->recent_cpu  = fp_add2(fp_multi(decay, t->recent_cpu), t->nice);
     }
 }
 
+/* Recomputes the priority of every thread whose recent_cpu or
+   nice changed since the previous pass. */
 void recalculate_priority()
 {
-    struct list_elem *e;
-    if (!list_empty(&all_thread_list))
+    while (!list_empty(&mlfqs_dirty_list))
     {
-        for (e = list_begin(&all_thread_list); e != list_end(&all_thread_list); e = list_next(e))
-        {
-            struct thread *t = list_entry(e, struct thread, adv_elem);
-            calculate_priority(t);
-        }
+        struct thread *t = list_entry(list_pop_front(&mlfqs_dirty_list), struct thread, dirty_elem);
+        t->mlfqs_dirty = false;
+        calculate_priority(t);
     }
 }
 
 void recent_cpu_add_1()
 {
     struct thread *curr = thread_current();
-    if (curr != idle_thread)
+    if (!is_idle(curr))
     {
         curr->recent_cpu = fp_add2(curr->recent_cpu, 1);
+        mlfqs_mark_dirty(curr);
+    }
+}
+
+/* Queues T for the next priority pass, if it is not already
+   queued.  Interrupts must be off. */
+static void mlfqs_mark_dirty(struct thread *t)
+{
+    ASSERT (intr_get_level () == INTR_OFF);
+    if (!is_idle(t) && !t->mlfqs_dirty)
+    {
+        t->mlfqs_dirty = true;
+        list_push_back(&mlfqs_dirty_list, &t->dirty_elem);
+    }
+}
+
+/* Brings T's recent_cpu up to date with the per-second decays it
+   missed while blocked and, if that changed it, recomputes T's
+   priority.  A semaphore waiter is moved to its new place in the
+   waiter list.  Interrupts must be off. */
+void mlfqs_catch_up(struct thread *t)
+{
+    ASSERT (intr_get_level () == INTR_OFF);
+    if (mlfqs_sync(t))
+        calculate_priority(t);
+}
+
+/* Applies to T every per-second decay it has not seen yet.
+   Returns true if T's recent_cpu changed. */
+static bool mlfqs_sync(struct thread *t)
+{
+    bool changed = false;
+
+    ASSERT (mlfqs_epoch - t->cpu_epoch <= MLFQS_HISTORY);
+    if (is_idle(t))
+    {
+        t->cpu_epoch = mlfqs_epoch;
+        return false;
+    }
+    while (t->cpu_epoch < mlfqs_epoch)
+    {
+        fp_float decay = decay_history[t->cpu_epoch % MLFQS_HISTORY];
+        t->recent_cpu = fp_add2(fp_multi(decay, t->recent_cpu), t->nice);
+        t->cpu_epoch++;
+        changed = true;
     }
+    return changed;
 }
 /* advanced */
 
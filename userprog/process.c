@@ -235,8 +235,6 @@ process_exec (void *f_name) {
 	if (!success)
 		return -1;
 	
-	// if (lock_held_by_current_thread(&filesys_lock))
-	// 	lock_release(&filesys_lock);
 	/* Start switched process. */
 	do_iret (&_if);
 	NOT_REACHED ();
@@ -430,7 +428,6 @@ load (const char *file_name, struct intr_frame *if_) {
 	process_activate (thread_current ());
 
 	/* Open executable file. */
-	lock_acquire(&filesys_lock);
 	file = filesys_open (file_name);
 	if (file == NULL) {
 		printf ("load: %s: open failed\n", file_name);
@@ -564,7 +561,6 @@ load (const char *file_name, struct intr_frame *if_) {
 done:
 	/* We arrive here whether the load is successful or not. */
 	// file_close (file);
-	lock_release(&filesys_lock);
 	return success;
 }
 
@@ -732,18 +728,13 @@ lazy_load_segment (struct page *page, void *aux) {
 	size_t page_read_bytes = info->read_bytes;
 	size_t page_zero_bytes = info->zero_bytes;
 	
-	/* 읽어야 하는 파일의 포인터를 옮겨준다.
-		struct file* 에는 pos라는 internal parameter가 있는데, 파일을 읽게 되면 파일의 pos 위치 부터 읽는다.
-		따라서, file의 pos를 offset 만큼 띄어줘야 한다. -> file_read_at을 사용하면 필요 없을 것 같으나,
-		후에 파일 swap 과의 일치를 위해서 냅둔다. */
-	file_seek (file, ofs);
-
 	/* 물리 프레임이 할당되지 않았을 경우 */
 	if (page->frame->kva == NULL)
 		return false;
 
-	/* 파일을 읽어 물리 프레임에 작성한다. */
-	if (file_read (file, page->frame->kva, page_read_bytes) != (int) page_read_bytes) {
+	/* 파일을 읽어 물리 프레임에 작성한다.
+		폴트 경로에서는 file의 pos 락을 잡지 않도록 file_read_at으로 오프셋을 직접 넘긴다. */
+	if (file_read_at (file, page->frame->kva, page_read_bytes, ofs) != (int) page_read_bytes) {
 		// palloc_free_page(page->frame->kva);
 		return false;
 	}
@@ -37,8 +37,6 @@ void syscall_handler (struct intr_frame *);
 
 void
 syscall_init (void) {
-	lock_init(&filesys_lock);
-
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
 			((uint64_t)SEL_KCSEG) << 32);
 	write_msr(MSR_LSTAR, (uint64_t) syscall_entry);
@@ -201,9 +199,7 @@ int write (int fd, const void *buffer, unsigned length)
 	default:
 		param = fd_to_file(fd);
 		if (param == NULL) return -1;
-		lock_acquire(&filesys_lock);
 		str_cnt = file_write(param, buffer, length);
-		lock_release(&filesys_lock);
 		break;
 	}
 	return str_cnt;
@@ -245,9 +241,7 @@ int read (int fd, void *buffer, unsigned length)
 #endif
 			fp = fd_to_file(fd);
 			if (fp == NULL) exit(-1);
-			lock_acquire(&filesys_lock);
 			str_cnt = file_read(fp, buffer, length);
-			lock_release(&filesys_lock);
 		}
 		break;
 	}
@@ -257,26 +251,20 @@ int read (int fd, void *buffer, unsigned length)
 bool create (const char *file, unsigned initial_size)
 {
 	bool success;
-	lock_acquire(&filesys_lock);
 	success = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
 	return success;
 }
 
 bool remove (const char *file)
 {
 	bool success;
-	lock_acquire(&filesys_lock);
 	success = filesys_remove(file);
-	lock_release(&filesys_lock);
 	return success;
 }
 
 int open (const char *file)
 {
-	lock_acquire(&filesys_lock);
 	struct file* param = filesys_open(file);
-	lock_release(&filesys_lock);
 	if (param == NULL) return -1;
 	int fd = thread_add_file(param);
 	return fd; 
@@ -309,9 +297,7 @@ void close (int fd)
 		exit(-1);
 	thread_current()->fdt[fd] = NULL;
 	thread_current()->nex_fd = fd;
-	lock_acquire(&filesys_lock);
 	file_close(param);
-	lock_release(&filesys_lock);
 }
 
 /* fd -> struct file* */
@@ -378,7 +364,7 @@ void *mmap (void *addr, size_t length, int writable, int fd, off_t offset){
 	// 파일의 길이가 0인 경우
 	if( file_length (file) == 0 || length <= 0 ) return NULL;
 	// is pre_allocated
-	if( spt_find_page(&thread_current()->spt, pg_round_down(addr)) != NULL) return NULL;
+	if( !spt_range_empty(&thread_current()->spt, addr, addr + length) ) return NULL;
 
 	return do_mmap(addr, length, writable, file, offset);
 }
@@ -1,6 +1,9 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/disk.h"
 #include "threads/mmu.h"
 
@@ -18,48 +21,81 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
-/* Swap Table */
-struct list swap_table;
+/* Swap slots.  A slot is the SECTORS_PER_PAGE consecutive sectors
+ * that hold one page; slot N starts at sector N * SECTORS_PER_PAGE.
+ * SWAP_MAP has a bit per slot, set while the slot is in use.
+ * Allocation is next-fit: it resumes scanning at SWAP_CURSOR, just
+ * past the last allocation, so that pages evicted one after another
+ * land next to each other on disk.
+ *
+ * A page keeps its slot after it is swapped in, as long as swap is
+ * not running short, so the slot acts as a swap cache: while the
+ * page stays clean the slot still matches it, and evicting it only
+ * has to drop the frame. */
+static struct bitmap *swap_map;
+static struct lock swap_lock;   /* Protects the members below. */
+static size_t swap_cursor;      /* Where the next scan starts. */
+static size_t swap_free_cnt;    /* Number of free slots. */
 
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
-	list_init(&swap_table);
+	size_t slot_cnt;
+
 	//1.1채널 (= 스왑디스크 용도)로 가져옴
 	swap_disk = disk_get(1, 1);
-	const disk_sector_t max_sector_size = disk_size(swap_disk);
-	//스왑 디스크를 8개의 섹터씩 그룹으로 초기화
-	for (int i = 0; i < max_sector_size; i += 8)
-	{
-		struct swap_anon *swap_anon = malloc(sizeof(struct swap_anon));
-		swap_anon->page = NULL;
-		swap_anon->use = false;
-		/*
-			i = 0 swap_anon1|0 1 2 3 4 5 6 7|
-			i = 1 swap_anon2|1 2 3 4 5 6 7 8|
-						...
-			i = max_sector_size-1
-		*/
-		for (int j = 0; j < 8; j++)
-			swap_anon->sectors[j] = i + j;
-		
-		list_push_back(&swap_table, &swap_anon->s_elem);
-	}
+	slot_cnt = swap_disk != NULL ? disk_size(swap_disk) / SECTORS_PER_PAGE : 0;
+	swap_map = bitmap_create(slot_cnt);
+	if (swap_map == NULL)
+		PANIC("cannot allocate swap map");
+	lock_init(&swap_lock);
+	swap_cursor = 0;
+	swap_free_cnt = slot_cnt;
+	zswap_init();
 }
 
-//swap_table에서 사용중이지 않는 페이지를 찾아 리턴
-static struct swap_anon*
-find_swap_table() {
-	struct list_elem *e = list_begin(&swap_table);
-	while (e != list_end(&swap_table))
-	{
-		struct swap_anon *temp_page = list_entry(e, struct swap_anon, s_elem);
-		if (!temp_page->use)
-			return temp_page;
-		e = list_next(e);
+/* Allocates CNT consecutive swap slots and returns the first, or
+ * BITMAP_ERROR if there is no such run free. */
+size_t
+swap_slot_alloc (size_t cnt) {
+	size_t slot;
+
+	lock_acquire(&swap_lock);
+	slot = bitmap_scan_and_flip(swap_map, swap_cursor, cnt, false);
+	if (slot == BITMAP_ERROR && swap_cursor != 0)
+		slot = bitmap_scan_and_flip(swap_map, 0, cnt, false);
+	if (slot != BITMAP_ERROR) {
+		swap_cursor = slot + cnt < bitmap_size(swap_map) ? slot + cnt : 0;
+		swap_free_cnt -= cnt;
 	}
-	return NULL;
+	lock_release(&swap_lock);
+	return slot;
+}
+
+/* Frees the CNT swap slots starting at SLOT. */
+void
+swap_slot_free (size_t slot, size_t cnt) {
+	lock_acquire(&swap_lock);
+	ASSERT(bitmap_all(swap_map, slot, cnt));
+	bitmap_set_multiple(swap_map, slot, cnt, false);
+	swap_free_cnt += cnt;
+	lock_release(&swap_lock);
+}
+
+/* Returns true if pages swapped in may keep their slots.  The swap
+ * cache gives way once fewer than a quarter of the slots are free, so
+ * that cached copies do not crowd out pages with nowhere else to go. */
+static bool
+swap_cache_enabled (void) {
+	return swap_free_cnt >= bitmap_size(swap_map) / 4;
+}
+
+/* Prints swap space usage. */
+void
+swap_print_stats (void) {
+	printf("Swap: %zu of %zu slots free\n", swap_free_cnt,
+			bitmap_size(swap_map));
 }
 
 /* Initialize the file mapping */
@@ -69,6 +105,92 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot = BITMAP_ERROR;
+	anon_page->zswap = 0;
+	return true;
+}
+
+/* Resets RA, the read-ahead state of an address space. */
+void
+swap_readahead_init (struct swap_readahead *ra) {
+	ra->next_va = NULL;
+	ra->start = NULL;
+	ra->cnt = 0;
+	ra->window = 0;
+}
+
+/* Counts the pages of the last read-ahead of the current process that
+ * were used, judging by their accessed bits, and resizes the window:
+ * it doubles when all were used and halves when fewer than half were. */
+static void
+readahead_judge (struct swap_readahead *ra) {
+	struct thread *curr = thread_current();
+	size_t hits = 0, i;
+
+	if (ra->cnt == 0)
+		return;
+	for (i = 0; i < ra->cnt; i++) {
+		void *va = ra->start + i * PGSIZE;
+		struct page *p = spt_find_page(&curr->spt, va);
+
+		if (p != NULL && p->frame != NULL && pml4_is_accessed(curr->pml4, va))
+			hits++;
+	}
+	vm_stats.readahead_hits += hits;
+
+	if (hits == ra->cnt)
+		ra->window = 2 * ra->window < SWAP_RA_MAX ? 2 * ra->window : SWAP_RA_MAX;
+	else if (hits < ra->cnt / 2)
+		ra->window /= 2;
+	ra->cnt = 0;
+}
+
+/* Collects in PAGES the swapped-out anonymous pages to read ahead of
+ * PAGE, which is being swapped in, and takes a spare frame for each
+ * into FRAMES.  Returns how many there are.
+ *
+ * Read-ahead only follows a sequential stream: a fault on the page
+ * just past the last fault, or past the last read-ahead.  It takes
+ * the pages that follow PAGE in memory for as long as they also
+ * follow it in swap, so that they all come in with PAGE in one disk
+ * command.  Clustered, next-fit slot allocation makes that the usual
+ * case for pages that were evicted together. */
+static size_t
+readahead_prepare (struct page *page, struct page *pages[],
+		struct frame *frames[]) {
+	struct thread *curr = thread_current();
+	struct swap_readahead *ra = &curr->spt.ra;
+	size_t slot = page->anon.swap_slot;
+	size_t cnt;
+
+	readahead_judge(ra);
+	// 순차 폴트가 아니면 창을 닫고 이 페이지만 읽는다.
+	if (page->va != ra->next_va) {
+		ra->next_va = page->va + PGSIZE;
+		ra->window = 0;
+		return 0;
+	}
+	if (ra->window < SWAP_RA_MIN)
+		ra->window = SWAP_RA_MIN;
+
+	for (cnt = 0; cnt < ra->window; cnt++) {
+		struct page *p = spt_find_page(&curr->spt, page->va + (cnt + 1) * PGSIZE);
+
+		// 디스크에서도 바로 뒤에 있는, 스왑 아웃된 익명 페이지만 같이 읽는다.
+		if (p == NULL || VM_TYPE(p->operations->type) != VM_ANON
+				|| p->frame != NULL || p->anon.swap_slot != slot + cnt + 1)
+			break;
+		frames[cnt] = vm_get_spare_frame();
+		if (frames[cnt] == NULL)
+			break;
+		pages[cnt] = p;
+	}
+
+	ra->start = page->va + PGSIZE;
+	ra->cnt = cnt;
+	ra->next_va = page->va + (cnt + 1) * PGSIZE;
+	vm_stats.readahead_pages += cnt;
+	return cnt;
 }
 
 /* Swap in the page by read contents from the swap disk. */
@@ -76,41 +198,155 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
-	struct swap_anon *swap_anon = anon_page->swap_anon;
-	//swap_table에서 8개의 섹터를 읽어와 kva에 해당하는 page에 로드함
-	for (size_t i = 0; i < 8; i++) {
-		disk_read(swap_disk, swap_anon->sectors[i], kva + DISK_SECTOR_SIZE * i);
+	size_t slot = anon_page->swap_slot;
+	struct page *ra_pages[SWAP_RA_MAX];
+	struct frame *ra_frames[SWAP_RA_MAX];
+	void *bufs[1 + SWAP_RA_MAX];
+	size_t ra_cnt, i;
+	bool keep;
+
+	// zswap에 압축되어 있으면 디스크 대신 메모리에서 푼다.
+	if (anon_page->zswap != 0) {
+		zswap_load(anon_page->zswap, kva);
+		anon_page->zswap = 0;
+		return true;
+	}
+	// 스왑된 적이 없는 페이지는 0으로 채워진 프레임 그대로 쓴다.
+	if (slot == BITMAP_ERROR)
+		return true;
+	// 순차적으로 폴트가 나고 있으면 뒤따르는 페이지들도 함께 읽는다.
+	ra_cnt = readahead_prepare(page, ra_pages, ra_frames);
+	bufs[0] = kva;
+	for (i = 0; i < ra_cnt; i++)
+		bufs[i + 1] = ra_frames[i]->kva;
+	//스왑 슬롯의 섹터들을 명령 한 번으로 읽어와 kva에 해당하는 page에 로드함
+	disk_readv(swap_disk, slot * SECTORS_PER_PAGE, bufs, 1 + ra_cnt, SECTORS_PER_PAGE);
+	// 스왑 공간이 넉넉하면 슬롯을 스왑 캐시로 남겨 두고, 아니면 반납한다.
+	keep = swap_cache_enabled();
+	if (!keep) {
+		anon_page->swap_slot = BITMAP_ERROR;
+		swap_slot_free(slot, 1);
 	}
-	//swap_in으로 인해 swap_table에서 나갔으니
-	//나간놈의 자리 초기화
-	anon_page->swap_anon = NULL;
-	swap_anon->use = false;
 
+	// 미리 읽은 페이지들은 폴트 없이 바로 쓸 수 있게 매핑해 둔다.
+	// 매핑에 실패한 페이지는 슬롯을 그대로 두어 다음 폴트 때 다시 읽는다.
+	for (i = 0; i < ra_cnt; i++) {
+		if (!vm_install_frame(ra_pages[i], ra_frames[i]) || keep)
+			continue;
+		ra_pages[i]->anon.swap_slot = BITMAP_ERROR;
+		swap_slot_free(slot + i + 1, 1);
+	}
 	return true;
 }
 
+/* Reads the contents of PAGE, which is swapped out, into the page at
+ * KVA, and leaves PAGE's copy where it is.  Fork uses it to give the
+ * child its own copy of a page that has no frame to share. */
+void
+anon_copy_swapped (struct page *page, void *kva) {
+	struct anon_page *anon_page = &page->anon;
+	void *bufs[1] = { kva };
+
+	ASSERT (page->frame == NULL);
+
+	if (anon_page->zswap != 0)
+		zswap_peek(anon_page->zswap, kva);
+	else if (anon_page->swap_slot != BITMAP_ERROR)
+		disk_readv(swap_disk, anon_page->swap_slot * SECTORS_PER_PAGE, bufs, 1,
+				SECTORS_PER_PAGE);
+	else
+		memset(kva, 0, PGSIZE);
+}
+
 /* Swap out the page by writing contents to the swap disk. */
 /* 내용을 스왑 디스크에 작성하여 페이지를 스왑 아웃합니다. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
-	//find_swap_table()에서 사용중이지 않는 anon_page 1개를 들고옴
-	struct swap_anon *swap_anon = find_swap_table();
-	// 8개의 섹터에 페이지 데이터를 스왑 디스크에 씀
-	for (int i = 0; i < 8; i++) {
-		disk_write(swap_disk, swap_anon->sectors[i], page->frame->kva + DISK_SECTOR_SIZE * i);
+	return anon_swap_out_cluster(&page, 1) == 1;
+}
+
+/* Swaps out the CNT anonymous PAGES, which must all be in frames,
+ * as one cluster.  A page whose swap slot still holds a clean copy is
+ * dropped without a write.  Any other page is compressed into zswap if
+ * zswap takes it, and otherwise written to swap: a dirtied page to its
+ * old slot, and the pages without a slot to consecutive new slots.
+ * The writes are merged into one disk command per run of consecutive
+ * slots.  Every page swapped out loses its frame; a page with room
+ * nowhere keeps its frame and its mapping.  Returns the number of
+ * pages swapped out. */
+size_t
+anon_swap_out_cluster (struct page *pages[], size_t cnt) {
+	struct page *homeless[SWAP_CLUSTER_MAX];
+	size_t slots[SWAP_CLUSTER_MAX];
+	const void *bufs[SWAP_CLUSTER_MAX];
+	size_t homeless_cnt = 0, write_cnt = 0, done = 0, slot, i, j;
+
+	ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER_MAX);
+
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+		struct anon_page *anon_page = &page->anon;
+		uint64_t *pml4 = page->frame->owner->pml4;
+
+		ASSERT(VM_TYPE(page->operations->type) == VM_ANON);
+		// 쓰는 동안 주인이 페이지를 고치지 못하도록 매핑부터 지운다.
+		// present 비트만 지워지므로 dirty 비트는 그 뒤에 읽어도 정확하다.
+		pml4_clear_page(pml4, page->va);
+		if (anon_page->swap_slot != BITMAP_ERROR
+				&& !pml4_is_dirty(pml4, page->va)) {
+			// 스왑 캐시의 사본이 그대로이니 쓰지 않고 프레임만 버린다.
+			vm_stats.swap_cache_drops++;
+		} else if (zswap_store(page->frame->kva, &anon_page->zswap)) {
+			// 압축해서 메모리에 담았으니 낡은 슬롯은 필요 없다.
+			if (anon_page->swap_slot != BITMAP_ERROR) {
+				swap_slot_free(anon_page->swap_slot, 1);
+				anon_page->swap_slot = BITMAP_ERROR;
+			}
+		} else if (anon_page->swap_slot != BITMAP_ERROR) {
+			slots[write_cnt] = anon_page->swap_slot;
+			bufs[write_cnt++] = page->frame->kva;
+		} else
+			homeless[homeless_cnt++] = page;
 	}
-	/*
-		swap_table에 들어왔으니 사용중으로 바꾸고
-		anon_page의 swap_anon정보 최신화 해주고
-		anon_page의 frame을 NULL로 swap_out으로 물리 메로리에 나왔으니
-		그리고 그 쓰레드에 pml4테이블에 자기 자신 날림
-	*/
-	swap_anon->use = true;
-	anon_page->swap_anon = swap_anon;
-	page->frame = NULL;
-	pml4_clear_page(thread_current()->pml4, page->va);
-	return true;
+
+	// 슬롯이 없는 페이지들에는 이어지는 새 슬롯을 주고, 안 되면 하나씩 준다.
+	slot = homeless_cnt > 0 ? swap_slot_alloc(homeless_cnt) : BITMAP_ERROR;
+	for (i = 0; i < homeless_cnt; i++) {
+		struct page *page = homeless[i];
+		size_t s = slot != BITMAP_ERROR ? slot + i : swap_slot_alloc(1);
+
+		if (s == BITMAP_ERROR) {
+			// 스왑 공간이 가득 찼다. 매핑을 되살려 페이지를 그대로 둔다.
+			pml4_set_page(page->frame->owner->pml4, page->va, page->frame->kva,
+					page->writable);
+			continue;
+		}
+		page->anon.swap_slot = s;
+		slots[write_cnt] = s;
+		bufs[write_cnt++] = page->frame->kva;
+	}
+
+	// 슬롯이 이어지는 페이지끼리 묶어 명령 한 번으로 스왑 디스크에 씀
+	for (i = 0; i < write_cnt; i = j) {
+		for (j = i + 1; j < write_cnt && slots[j] == slots[j - 1] + 1; j++)
+			continue;
+		disk_writev(swap_disk, slots[i] * SECTORS_PER_PAGE, &bufs[i], j - i,
+				SECTORS_PER_PAGE);
+	}
+	vm_stats.anon_writebacks += write_cnt;
+	if (zswap_enabled)
+		zswap_stats.writebacks += write_cnt;
+
+	// anon_page의 frame을 NULL로 swap_out으로 물리 메로리에 나왔으니
+	for (i = 0; i < cnt; i++) {
+		struct anon_page *anon_page = &pages[i]->anon;
+
+		if (anon_page->swap_slot == BITMAP_ERROR && anon_page->zswap == 0)
+			continue;
+		pages[i]->frame = NULL;
+		done++;
+	}
+	return done;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
@@ -118,5 +354,9 @@ anon_swap_out (struct page *page) {
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	// list_remove(&page->frame->f_elem);
+	vm_release_frame(page);
+	if (anon_page->swap_slot != BITMAP_ERROR)
+		swap_slot_free(anon_page->swap_slot, 1);
+	if (anon_page->zswap != 0)
+		zswap_free(anon_page->zswap);
 }
@@ -49,9 +49,7 @@ file_backed_swap_in (struct page *page, void *kva) {
 	int page_read_bytes = file_page->read_bytes;
 	int page_zero_bytes = file_page->zero_bytes;
 
-	file_seek(file, ofs);
-
-	page_read_bytes == (int)file_read(file,page->frame->kva, page_read_bytes);
+	file_read_at(file, page->frame->kva, page_read_bytes, ofs);
 
 	memset(page->frame->kva + page_read_bytes, 0, page_zero_bytes);
 	page->swapped = false;
@@ -63,14 +61,18 @@ file_backed_swap_in (struct page *page, void *kva) {
 static bool
 file_backed_swap_out (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
+	// 프레임 주인의 pml4를 봐야 한다. 다른 프로세스의 페이지일 수도 있다.
+	uint64_t *pml4 = page->frame->owner->pml4;
+	// 매핑을 먼저 지운다. 지워도 dirty 비트는 남아 있다.
+	pml4_clear_page(pml4, page->va);
 	
-	if (pml4_is_dirty(thread_current()->pml4, page->va)) {
+	if (pml4_is_dirty(pml4, page->va)) {
 		file_write_at(file_page->file, page->frame->kva, file_page->read_bytes, file_page->offset);
-		pml4_set_dirty(thread_current()->pml4, page->va, false);
+		pml4_set_dirty(pml4, page->va, false);
+		vm_stats.file_writebacks++;
 	}
 	page->frame = NULL;
 	page->swapped = true;
-	pml4_clear_page(thread_current()->pml4, page->va);
 
 	return true;
 }
@@ -85,7 +87,7 @@ file_backed_destroy (struct page *page) {
 		file_write_at(file_page->file, page->va, file_page->read_bytes, file_page->offset);
 		pml4_set_dirty(t->pml4, page->va, false);
 	}
-	// list_remove(&page->frame->f_elem);
+	vm_release_frame(page);
 	pml4_clear_page(t->pml4, page->va);
 }
 
@@ -99,15 +101,13 @@ lazy_load_segment_by_file (struct page *page, void *aux) {
 	size_t page_read_bytes = info->read_bytes;
 	size_t page_zero_bytes = info->zero_bytes;
 	
-	file_seek (file, offset); 
-
 	if(page->frame->kva == NULL) 
 		return false;
 
 	/* Do calculate how to fill this page.
 	 * We will read PAGE_READ_BYTES bytes from FILE
 	 * and zero the final PAGE_ZERO_BYTES bytes. */
-	if (file_read(file, page->frame->kva, page_read_bytes) != (int) page_read_bytes) {
+	if (file_read_at(file, page->frame->kva, page_read_bytes, offset) != (int) page_read_bytes) {
 		return false;
 	}
 
@@ -170,20 +170,27 @@ do_mmap (void *addr, size_t length, int writable,
 	return addr;
 }
 
+/* Helper for do_munmap(): extends the mapping that ends at *END_ by
+ * PAGE, if PAGE is the next page of it.  Returns false once the end of
+ * the mapping is reached. */
+static bool
+extend_mapping (struct page *page, void *end_) {
+	void **end = end_;
+
+	if (page->va != *end)
+		return false;
+	*end += PGSIZE;
+	return page->file.has_next;
+}
+
 /* Do the munmap */
 void
 do_munmap (void *addr) {
 	struct thread *t = thread_current();
-	struct page *page = spt_find_page(&t->spt, addr);
-	
-	if (!page)
-		return;
-	
-	bool has_next;
-	do {
-		has_next = page->file.has_next;
-		spt_remove_page(&t->spt, page);
-		addr += PGSIZE;
-	} while (has_next && (page = spt_find_page(&t->spt, addr)));
+	void *end = addr;
+
+	// 매핑의 끝을 찾은 뒤 그 범위의 페이지를 한 번에 제거한다.
+	spt_walk_range(&t->spt, addr, (void *) KERN_BASE, extend_mapping, &end);
+	spt_remove_range(&t->spt, addr, end);
 }
 /* Project 3 */
\ No newline at end of file
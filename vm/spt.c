@@ -0,0 +1,256 @@
+/* spt.c: Supplemental page table, as a radix tree indexed by virtual
+ * page number. */
+
+#include "vm/vm.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* The tree has the same shape as the x86-64 page table: four levels
+ * of page-sized nodes with 512 slots each, indexed by the same nine-bit
+ * fields of the virtual address that PML4(), PDPE(), PDX() and PTX()
+ * extract.  Slots of the leaf level (level 0) point to struct pages;
+ * slots of the other levels hold entries for the nodes below them.
+ *
+ * Nodes are page-aligned, so an entry keeps the number of used slots
+ * of the node it points to in its low bits, much as a PTE keeps its
+ * flags there.  A node is freed as soon as that count drops to zero,
+ * which lets the tree shrink back as pages are removed. */
+
+#define SPT_LEVELS 4
+#define SPT_BITS 9
+#define SPT_SLOTS (1 << SPT_BITS)
+
+/* Number of virtual pages the tree can index. */
+#define SPT_VPN_LIMIT ((uint64_t) 1 << (SPT_LEVELS * SPT_BITS))
+
+#define entry_node(E) ((uint64_t *) ((E) & ~(uint64_t) PGMASK))
+#define entry_cnt(E) ((E) & PGMASK)
+
+/* Returns the slot for VPN in a node at LEVEL. */
+static inline size_t
+slot_idx (uint64_t vpn, int level) {
+	return (vpn >> (level * SPT_BITS)) & (SPT_SLOTS - 1);
+}
+
+/* Returns the number of pages spanned by one slot of a node at LEVEL. */
+static inline uint64_t
+slot_span (int level) {
+	return (uint64_t) 1 << (level * SPT_BITS);
+}
+
+static void prune (uint64_t *path[], int level);
+static bool walk (uint64_t entry, int level, uint64_t base,
+		uint64_t start, uint64_t end, spt_walk_func *, void *aux);
+static void remove_range (uint64_t *entry, int level, uint64_t base,
+		uint64_t start, uint64_t end);
+
+/* Initialize new supplemental page table */
+void
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	spt->root = 0;
+	swap_readahead_init (&spt->ra);
+}
+
+/* Find VA from spt and return page. On error, return NULL. */
+struct page *
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	uint64_t vpn = pg_no (va);
+	uint64_t entry = spt->root;
+	int level;
+
+	if (vpn >= SPT_VPN_LIMIT)
+		return NULL;
+	for (level = SPT_LEVELS - 1; level > 0; level--) {
+		if (entry == 0)
+			return NULL;
+		entry = entry_node (entry)[slot_idx (vpn, level)];
+	}
+	return entry != 0 ? (struct page *) entry_node (entry)[slot_idx (vpn, 0)]
+		: NULL;
+}
+
+/* Insert PAGE into spt with validation. */
+bool
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	uint64_t *path[SPT_LEVELS];
+	uint64_t vpn = pg_no (page->va);
+	uint64_t *entry = &spt->root;
+	uint64_t *slot;
+	int level;
+
+	if (vpn >= SPT_VPN_LIMIT)
+		return false;
+
+	/* Walk down, creating missing nodes.  PATH[L] is the entry for the
+	 * node at level L. */
+	for (level = SPT_LEVELS - 1; level >= 0; level--) {
+		path[level] = entry;
+		if (*entry == 0) {
+			uint64_t *node = palloc_get_page (PAL_ZERO);
+			if (node == NULL) {
+				prune (path, level + 1);
+				return false;
+			}
+			*entry = (uint64_t) node;
+			if (level + 1 < SPT_LEVELS)
+				(*path[level + 1])++;
+		}
+		entry = &entry_node (*entry)[slot_idx (vpn, level)];
+	}
+
+	slot = entry;
+	if (*slot != 0)
+		return false;
+	*slot = (uint64_t) page;
+	(*path[0])++;
+	return true;
+}
+
+/* Removes PAGE from SPT and frees it. */
+void
+spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	uint64_t *path[SPT_LEVELS];
+	uint64_t vpn = pg_no (page->va);
+	uint64_t *entry = &spt->root;
+	int level;
+
+	if (vpn >= SPT_VPN_LIMIT)
+		return;
+	for (level = SPT_LEVELS - 1; level >= 0; level--) {
+		if (*entry == 0)
+			return;
+		path[level] = entry;
+		entry = &entry_node (*entry)[slot_idx (vpn, level)];
+	}
+	if (*entry != (uint64_t) page)
+		return;
+
+	*entry = 0;
+	(*path[0])--;
+	prune (path, 0);
+	vm_dealloc_page (page);
+}
+
+/* Calls FUNC on each page in SPT whose address is in [START, END), in
+ * ascending order of address, until FUNC returns false.  Returns false
+ * if FUNC did, true otherwise.  FUNC must not add pages to SPT or
+ * remove them from it. */
+bool
+spt_walk_range (struct supplemental_page_table *spt, void *start, void *end,
+		spt_walk_func *func, void *aux) {
+	uint64_t first = pg_no (start);
+	uint64_t last = pg_no ((uint8_t *) end + PGSIZE - 1);
+
+	if (last > SPT_VPN_LIMIT)
+		last = SPT_VPN_LIMIT;
+	if (spt->root == 0 || first >= last)
+		return true;
+	return walk (spt->root, SPT_LEVELS - 1, 0, first, last, func, aux);
+}
+
+/* Removes and frees every page in SPT whose address is in
+ * [START, END).  Nodes left empty are freed, so a range that covers
+ * whole subtrees releases them without visiting their empty slots. */
+void
+spt_remove_range (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	uint64_t first = pg_no (start);
+	uint64_t last = pg_no ((uint8_t *) end + PGSIZE - 1);
+
+	if (last > SPT_VPN_LIMIT)
+		last = SPT_VPN_LIMIT;
+	if (spt->root == 0 || first >= last)
+		return;
+	remove_range (&spt->root, SPT_LEVELS - 1, 0, first, last);
+}
+
+/* Helper for spt_range_empty(). */
+static bool
+stop_at_page (struct page *page UNUSED, void *aux UNUSED) {
+	return false;
+}
+
+/* Returns true if no page in SPT has an address in [START, END). */
+bool
+spt_range_empty (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	return spt_walk_range (spt, start, end, stop_at_page, NULL);
+}
+
+/* Free the resource hold by the supplemental page table */
+void
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	/* The table stays usable: exec kills it and then loads a new
+	 * image into it. */
+	if (spt->root != 0)
+		remove_range (&spt->root, SPT_LEVELS - 1, 0, 0, SPT_VPN_LIMIT);
+	swap_readahead_init (&spt->ra);
+}
+
+/* Frees the nodes on PATH, from LEVEL upward, that have no used slots,
+ * and clears the entries that pointed to them. */
+static void
+prune (uint64_t *path[], int level) {
+	for (; level < SPT_LEVELS; level++) {
+		if (entry_cnt (*path[level]) != 0)
+			break;
+		palloc_free_page (entry_node (*path[level]));
+		*path[level] = 0;
+		if (level + 1 < SPT_LEVELS)
+			(*path[level + 1])--;
+	}
+}
+
+/* Calls FUNC on the pages in [START, END) below ENTRY, a node at LEVEL
+ * whose first slot maps page BASE.  Returns false if FUNC did. */
+static bool
+walk (uint64_t entry, int level, uint64_t base, uint64_t start,
+		uint64_t end, spt_walk_func *func, void *aux) {
+	uint64_t *node = entry_node (entry);
+	uint64_t span = slot_span (level);
+	size_t i = start > base ? (start - base) / span : 0;
+
+	for (; i < SPT_SLOTS && base + i * span < end; i++) {
+		if (node[i] == 0)
+			continue;
+		if (level == 0) {
+			if (!func ((struct page *) node[i], aux))
+				return false;
+		} else if (!walk (node[i], level - 1, base + i * span, start, end,
+					func, aux))
+			return false;
+	}
+	return true;
+}
+
+/* Removes and frees the pages in [START, END) below *ENTRY, a node at
+ * LEVEL whose first slot maps page BASE.  Frees the node and clears
+ * *ENTRY if no slots remain in use. */
+static void
+remove_range (uint64_t *entry, int level, uint64_t base, uint64_t start,
+		uint64_t end) {
+	uint64_t *node = entry_node (*entry);
+	uint64_t span = slot_span (level);
+	size_t i = start > base ? (start - base) / span : 0;
+
+	for (; i < SPT_SLOTS && base + i * span < end; i++) {
+		if (node[i] == 0)
+			continue;
+		if (level == 0) {
+			struct page *page = (struct page *) node[i];
+			node[i] = 0;
+			(*entry)--;
+			vm_dealloc_page (page);
+		} else {
+			remove_range (&node[i], level - 1, base + i * span, start, end);
+			if (node[i] == 0)
+				(*entry)--;
+		}
+	}
+
+	if (entry_cnt (*entry) == 0) {
+		palloc_free_page (node);
+		*entry = 0;
+	}
+}
@@ -1,37 +1,52 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <round.h>
+#include <stdio.h>
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "string.h"
 
-/* Project 3 */
-uint64_t hash_hash_func_impl(const struct hash_elem *e, void *aux){
-    // elem의 필드를 사용하여 해시 값을 계산하여 반환
-	struct page *p = hash_entry(e, struct page, h_elem);
-	return hash_bytes(&p->va, sizeof p->va);
-}
-// 해시 비교 함수
-bool hash_less_func_impl (const struct hash_elem *a_, const struct hash_elem *b_, void *aux){
-	struct page *a = hash_entry(a_, struct page, h_elem);
-	struct page *b = hash_entry(b_, struct page, h_elem);
-	return a->va < b->va;
-}
+/* Object cache for struct page. */
+static struct kmem_cache *page_cache;
 
-/* Performs some operation on hash element E, given auxiliary
- * data AUX. */
-// 해시에 들어간 페이지를 할당 해제하고 삭제
-void hash_action_func_impl (struct hash_elem *e, void *aux){
-	struct page *p = hash_entry(e, struct page, h_elem);
-	// list_remove(&p->frame->f_elem);
-	// p->frame = NULL;
-	// pml4_clear_page(thread_current()->pml4, p->va);
-	destroy(p);
-	free(p);
-}
-/* Project 3 */
+/* Frame table: one descriptor per page of the user pool, indexed by
+ * palloc_user_page_idx(). */
+static struct frame *frame_table;
+static size_t frame_cnt;
+static struct lock frame_lock;  /* Protects frame_table and clock_hand. */
+static size_t clock_hand;       /* Next frame the clock examines. */
+
+/* If true, evict with the two-handed clock.
+ * Controlled by kernel command-line option "-clock2". */
+bool vm_two_handed_clock;
+
+/* Largest distance between the hands of the two-handed clock. */
+#define CLOCK_SPREAD 256
+
+/* Page-out daemon.  It wakes when fewer than low_watermark user
+ * frames are free and evicts, KSWAPD_BATCH frames at a time, until
+ * high_watermark are, so that faults seldom have to evict.  Each
+ * batch is swapped out as one cluster. */
+static struct semaphore kswapd_wake;
+static bool kswapd_awake;
+static size_t low_watermark, high_watermark;
+#define KSWAPD_BATCH SWAP_CLUSTER_MAX
+
+/* Held while a page is being swapped out, so that a fault on that
+ * page can wait for it to finish. */
+static struct lock evict_lock;
+
+/* Page-out statistics. */
+struct vm_stats vm_stats;
+
+static void kswapd (void *aux);
+static void kswapd_poke (void);
+
+static bool copy_page (struct page *src_page, void *dst);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -46,8 +61,19 @@ vm_init (void) {
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
 	// 프레임 테이블과 프레임 락 초기화
-	list_init(&frame_table);
 	lock_init(&frame_lock);
+	frame_cnt = palloc_user_page_cnt();
+	frame_table = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP(frame_cnt * sizeof *frame_table, PGSIZE));
+	page_cache = kmem_cache_create("page", sizeof(struct page), NULL);
+
+	// 빈 프레임이 low_watermark 아래로 떨어지면 kswapd가 깨어난다.
+	lock_init(&evict_lock);
+	sema_init(&kswapd_wake, 0);
+	low_watermark = frame_cnt / 64 > 4 ? frame_cnt / 64 : 4;
+	high_watermark = 2 * low_watermark;
+	if (thread_create("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR)
+		PANIC("cannot start kswapd");
 	// 스왑 테이블 할당
 }
 
@@ -69,6 +95,7 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static size_t vm_evict_frames (struct frame *victims[], size_t cnt);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -90,7 +117,9 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	// 요청한 주소가 이미 가상 메모리가(page) 할당되어 있는지 확인
 	if (spt_find_page (spt, upage) == NULL) {
 		// 없다면 페이지 메모리 할당 후 타입에 따라 처리한다.
-		struct page *newpage = malloc(sizeof(struct page));
+		struct page *newpage = kmem_cache_alloc(page_cache);
+		if (newpage == NULL)
+			goto err;
 
 		// 각 페이지는 page algined 이어야 하기 때문에 pg_round_down을 이용, 페이지의 시작 주소를 넘겨준다.
 		// vm type에 따라 초기화 함수를 다르게 지정해준다.
@@ -109,6 +138,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		}
 		/* after uninit_new, you have to fix fields. */
 		newpage->writable = writable;
+		newpage->owner = thread_current();
 		
 		// 보조 페이지 테이블은 spt에 삽입한다.
 		/* TODO: Insert the page into the spt. */
@@ -122,115 +152,133 @@ err:
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
-// spt 안의 해시 테이블에서 h_elem으로 hash_elem을 뽑아내고 그걸 기반으로 hash_entry로 page 객체로 접근한다.
-struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = (struct page*)malloc(sizeof(struct page));
-	page->va = pg_round_down(va);	// va가 가리키는 가상 페이지의 시작 포인트 (오프셋이 0으로 설정된 va) 반환
-
-	struct hash_elem *e = hash_find(&spt->hash_brown, &page->h_elem);
-
-	free(page);
-
-	return e != NULL ? hash_entry(e, struct page, h_elem) : NULL;
+/* Returns true if the clock may evict F: it backs exactly one page,
+ * and is not being loaded or evicted. */
+static bool
+frame_evictable (const struct frame *f) {
+	return f->page != NULL && f->map_cnt == 1;
 }
 
-/* Insert PAGE into spt with validation. */
-bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-
-	if (hash_insert(&spt->hash_brown, &page->h_elem) == NULL)
-		succ = true;
-	return succ;
-}
+/* Returns true if F's page was accessed since the last call, and
+ * clears its accessed bit.  Uses the owner's pml4, since F may belong
+ * to another process. */
+static bool
+frame_test_and_clear_accessed (struct frame *f) {
+	uint64_t *pml4 = f->owner->pml4;
 
-void
-spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	struct hash_elem *result = hash_delete(&spt->hash_brown, &page->h_elem);
-	if (result == NULL)
+	if (!pml4_is_accessed(pml4, f->page->va))
 		return false;
-
-	vm_dealloc_page (page);
+	pml4_set_accessed(pml4, f->page->va, false);
 	return true;
 }
 
 /* Get the struct frame, that will be evicted. */
-// disk swap시에 희생자 페이지를 정하는 알고리즘 CLOCK 알고리즘으로 짜여져 있다 LRU도 가능하다
+// disk swap시에 희생자 페이지를 정하는 알고리즘 CLOCK 알고리즘으로 짜여져 있다.
+// 시곗바늘(clock_hand)은 호출 사이에 유지되므로 매번 처음부터 다시 돌지 않는다.
+// 두 바늘 CLOCK에서는 앞 바늘이 CLOCK_SPREAD만큼 앞서 가며 접근 비트를 지우고,
+// 뒤 바늘은 그 사이 다시 접근되지 않은 프레임을 고른다. 그래서 한 번 찾는 비용이
+// 메모리 크기가 아니라 두 바늘 사이 거리에 비례한다.
 static struct frame *
 vm_get_victim (void) {
+	size_t spread = frame_cnt / 2 < CLOCK_SPREAD ? frame_cnt / 2 : CLOCK_SPREAD;
+	size_t n;
 
-	 struct frame *victim = NULL;
-	/* TODO: The policy for eviction is up to you. */
-	/* only manages frames for user pages (PAL_USER) */
-
-	/* Project 3 - Swap DISK (CLOCK algorithm) */
-	/* Q1: Clock 알고리즘에서 시작하는 주소는 항상 프레임 테이블의 처음이어도 될까? */
-	/* A1: 어디서 시작하든 상관 없을것 같음, 하지만 필요하다면 마지막에 시곗바늘이 멈춘 곳을 저장해도 좋을듯 */
-	/* Q2: 전역 변수로 위치를 저장해둔다면 어떻게 해야되나? */
-	/* A2: frame_table에 마지막 으로 선정한 위치 e를 저장하고 알고리즘 시작 전 리스트를 순회하여 저장한 위치와 맞는 elem을 꺼내야한다.
-		   그러나 이는 매우 비효율적이므로 알고리즘 시작 전, frame table을 정렬한 후 찾는걸 추천 */
-	/* Q3: No need to frame_lock? */
-	/* A3: need lock 연산의 원자성을 보장해야 함. 그러지 않으면 연산 도중 잦은 접근 비트 변경으로 인해 잘못된 페이지가 
-	       선택되고 이로인해 성능의 저하가 발생할 수 있음. */
-	lock_acquire(&frame_lock);
-	struct list_elem *e = list_begin(&frame_table);
-	// 리스트에서 원소 하나를 꺼내어 알고리즘에 의해 어느 한 프레임이 선택될 때까지 순회한다.
-	while (e)
-	{
-		struct frame *cur_frame = list_entry(e, struct frame, f_elem);
-		uint64_t *cur_pml4 = thread_current()->pml4;
-		const void* upage = cur_frame->page->va;
-
-		// 클락 알고리즘은 참조된 적이 있는 프레임에 접근하면 해당 프레임의 참조 비트를 초기화하고
-		/* if kernel address */
-		if (pml4_is_accessed(cur_pml4, cur_frame->page->va))
-			pml4_set_accessed(cur_pml4, cur_frame->page->va, false);
-		else 
-		{
-			// 참조된 적이 없는 프레임에 도달할 때까지 순회한다.
-			// 참조된 적이 없는 프레임에 도달하면 해당 프레임을 선택하고 순회를 종료한다.
-			victim = cur_frame;
-			break;
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (n = 0; n < 2 * frame_cnt; n++) {
+		struct frame *f;
+
+		if (vm_two_handed_clock) {
+			struct frame *front = &frame_table[(clock_hand + spread) % frame_cnt];
+			if (frame_evictable(front))
+				frame_test_and_clear_accessed(front);
 		}
-		
-		if (e == list_end(&frame_table))
-		{
-			e = list_begin(&frame_table);
+
+		f = &frame_table[clock_hand];
+		clock_hand = (clock_hand + 1) % frame_cnt;
+		if (!frame_evictable(f))
 			continue;
+		if (vm_two_handed_clock
+				? !pml4_is_accessed(f->owner->pml4, f->page->va)
+				: !frame_test_and_clear_accessed(f))
+			return f;
+	}
+	return NULL;
+}
+
+/* Evicts up to CNT frames, which must be at most SWAP_CLUSTER_MAX,
+ * stores them in VICTIMS, and returns how many were evicted.  The
+ * anonymous pages among the victims are swapped out together, as one
+ * cluster, so that a batch costs one disk command instead of one per
+ * page.  The caller may already hold evict_lock, as fork does while it
+ * copies the address space. */
+// vm_get_victim 함수로 설정된 희생자 프레임들을 VICTIMS에 담아주는 함수
+static size_t
+vm_evict_frames (struct frame *victims[], size_t cnt) {
+	struct page *pages[SWAP_CLUSTER_MAX];
+	struct page *cluster[SWAP_CLUSTER_MAX];
+	size_t n, cluster_cnt = 0, evicted = 0, i;
+	bool held = lock_held_by_current_thread(&evict_lock);
+
+	ASSERT (cnt <= SWAP_CLUSTER_MAX);
+
+	if (!held)
+		lock_acquire(&evict_lock);
+	lock_acquire(&frame_lock);
+	// 스왑 아웃하는 동안 다른 스레드가 같은 프레임을 고르지 못하게 떼어 둔다.
+	for (n = 0; n < cnt; n++) {
+		victims[n] = vm_get_victim ();
+		if (victims[n] == NULL)
+			break;
+		pages[n] = victims[n]->page;
+		victims[n]->page = NULL;
+	}
+	lock_release(&frame_lock);
+
+	// 익명 페이지들은 연속된 스왑 슬롯에 한꺼번에 쓴다.
+	for (i = 0; i < n; i++)
+		if (VM_TYPE (pages[i]->operations->type) == VM_ANON)
+			cluster[cluster_cnt++] = pages[i];
+	if (cluster_cnt > 0)
+		anon_swap_out_cluster(cluster, cluster_cnt);
+
+	// 익명 페이지는 프레임이 떼어졌으면 성공이다. 나머지는 해당페이지 초기화시에
+	// swap_out으로 매핑된 함수를 실행하게 되는데,
+	// 스왑 아웃하는데 실패한 프레임은 원래 페이지에 돌려준다.
+	lock_acquire(&frame_lock);
+	for (i = 0; i < n; i++) {
+		struct frame *victim = victims[i];
+		bool success;
+
+		if (VM_TYPE (pages[i]->operations->type) == VM_ANON)
+			success = pages[i]->frame == NULL;
+		else {
+			lock_release(&frame_lock);
+			success = swap_out(pages[i]);
+			lock_acquire(&frame_lock);
 		}
-		e = list_next(e);
+		if (success) {
+			list_remove(&pages[i]->frame_elem);
+			victim->owner = NULL;
+			victim->map_cnt = 0;
+			victims[evicted++] = victim;
+		} else
+			victim->page = pages[i];
 	}
 	lock_release(&frame_lock);
-	return victim;
+	if (!held)
+		lock_release(&evict_lock);
+
+	return evicted;
 }
 
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
-// vm_get_victim 함수로 설정된 희생자 프레임을 반환해주는 함수
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-	// 희생자로 선택되어 곧 죽을거니까 프레임 테이블에서도 빼버린다
-	list_remove(&victim->f_elem);
-	// 희생자가 선택되지 않았으면 패닉에 빠진다.
-	if (victim != NULL) {
-		// 해당페이지 초기화시에 swap_out으로 매핑된 함수를 실행하게 되는데,
-		// 스왑 아웃하는데 실패하면 NULL을 반환한다.
-		// 희생자가 잔혹하게 희생되는 모습. ㅠㅠ
-		if (!swap_out(victim->page))
-			return NULL;
-
-		return victim;
-	}
-	else {
-		PANIC("PANIC!");
-	}
+	struct frame *victim;
 
-	return NULL;
+	return vm_evict_frames(&victim, 1) == 1 ? victim : NULL;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
@@ -240,23 +288,197 @@ vm_evict_frame (void) {
 /* user 풀로부터 새로운 물리 페이지를 palloc_get_page를 통해 생성한다. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = (struct frame*)malloc(sizeof(struct frame));
+	struct frame *frame;
 	// 유저 풀에서 0으로 초기화된 따끈따끈한 물리 프레임
-    frame->kva = palloc_get_page(PAL_USER | PAL_ZERO);
+	void *kva = palloc_get_page(PAL_USER | PAL_ZERO);
 	// 만약 유저 풀에 자리가 없어 새 프레임을 얻을 수 없다면 
-    if (frame->kva == NULL) {
-		// PANIC("TODO. ");
-		// 희생자를 선택한다. ( OS는 잔혹하다 )
-		// 희생자 프레임을 얻은 후 해당 프레임에 기존에 연결되어있던 가상 페이지를 NULL로 초기화 한 후 반환
-        frame = vm_evict_frame();
-        frame->page = NULL;
-
-        return frame;
-    }
-	
-    frame->page = NULL;
+	kswapd_poke();
+	if (kva == NULL) {
+		// kswapd가 따라오지 못했으면 직접 희생자를 선택한다. ( OS는 잔혹하다 )
+		frame = vm_evict_frame();
+		if (frame == NULL)
+			PANIC("failed to evict a frame");
+		vm_stats.direct_evictions++;
+		memset(frame->kva, 0, PGSIZE);
+		return frame;
+	}
+
+	// 프레임 테이블은 물리 프레임 번호로 바로 찾는다.
+	frame = &frame_table[palloc_user_page_idx(kva)];
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->owner = NULL;
+	frame->map_cnt = 0;
+	list_init(&frame->sharers);
+	return frame;
+}
+
+/* Returns a free frame, or NULL if taking one would leave no more
+ * than low_watermark frames free.  Never evicts: read-ahead uses it,
+ * and must not push out pages to make room for pages that may never
+ * be used. */
+struct frame *
+vm_get_spare_frame (void) {
+	struct frame *frame;
+	void *kva;
+
+	if (palloc_user_free_cnt() <= low_watermark)
+		return NULL;
+	kva = palloc_get_page(PAL_USER);
+	kswapd_poke();
+	if (kva == NULL)
+		return NULL;
+
+	frame = &frame_table[palloc_user_page_idx(kva)];
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->owner = NULL;
+	frame->map_cnt = 0;
+	list_init(&frame->sharers);
+	return frame;
+}
 
-    return frame;
+/* Makes FRAME, which already holds PAGE's contents, back PAGE in the
+ * current process.  On failure, frees FRAME and returns false. */
+bool
+vm_install_frame (struct page *page, struct frame *frame) {
+	struct thread *curr = thread_current();
+
+	if (!pml4_set_page(curr->pml4, page->va, frame->kva, page->writable)) {
+		palloc_free_page(frame->kva);
+		return false;
+	}
+	frame->owner = curr;
+	frame->map_cnt = 1;
+	page->frame = frame;
+
+	lock_acquire(&frame_lock);
+	list_push_back(&frame->sharers, &page->frame_elem);
+	frame->page = page;
+	lock_release(&frame_lock);
+	return true;
+}
+
+/* Wakes kswapd if free user frames are below the low watermark. */
+static void
+kswapd_poke (void) {
+	if (!kswapd_awake && palloc_user_free_cnt() < low_watermark) {
+		kswapd_awake = true;
+		sema_up(&kswapd_wake);
+	}
+}
+
+/* Page-out daemon.  Evicts frames back to the user pool until the
+ * high watermark is reached, yielding after each batch so that
+ * faulting threads can use the frames it has freed.  kswapd_awake is
+ * cleared before the last look at the free count, so that a poke it
+ * swallowed while awake is not lost. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		bool stuck = false;
+
+		sema_down(&kswapd_wake);
+		vm_stats.kswapd_wakeups++;
+
+		for (;;) {
+			while (palloc_user_free_cnt() < high_watermark) {
+				struct frame *victims[KSWAPD_BATCH];
+				size_t n, i;
+
+				n = vm_evict_frames(victims, KSWAPD_BATCH);
+				for (i = 0; i < n; i++)
+					palloc_free_page(victims[i]->kva);
+				vm_stats.kswapd_evictions += n;
+				if (n < KSWAPD_BATCH) {
+					stuck = true;
+					break;
+				}
+				thread_yield();
+			}
+			// 깃발을 먼저 내린 뒤 다시 확인해야 그 사이의 깨움을 놓치지 않는다.
+			// 더 쫓아낼 것이 없으면 다음 깨움을 기다린다.
+			kswapd_awake = false;
+			if (stuck || palloc_user_free_cnt() >= low_watermark)
+				break;
+			kswapd_awake = true;
+		}
+	}
+}
+
+/* Prints page-out statistics. */
+void
+vm_print_stats (void) {
+	printf ("Page-out: %lld kswapd wakeups, %lld kswapd evictions, "
+			"%lld direct evictions, %lld anon writebacks, "
+			"%lld file writebacks\n",
+			vm_stats.kswapd_wakeups, vm_stats.kswapd_evictions,
+			vm_stats.direct_evictions, vm_stats.anon_writebacks,
+			vm_stats.file_writebacks);
+	printf ("Swap read-ahead: %lld pages, %lld hits; "
+			"swap cache: %lld clean drops\n",
+			vm_stats.readahead_pages, vm_stats.readahead_hits,
+			vm_stats.swap_cache_drops);
+	swap_print_stats ();
+	zswap_print_stats ();
+}
+
+/* Records that PAGE also maps frame F, which keeps the clock from
+ * evicting it while it is shared. */
+static void
+frame_share (struct frame *f, struct page *page) {
+	lock_acquire(&frame_lock);
+	list_push_back(&f->sharers, &page->frame_elem);
+	f->map_cnt++;
+	lock_release(&frame_lock);
+}
+
+/* Removes PAGE from the pages sharing frame F.  If PAGE was the one
+ * the clock would evict, a page that still maps F takes its place, so
+ * that F becomes evictable again once it is no longer shared.  Returns
+ * true if no page maps F any more.  Called with frame_lock held. */
+static bool
+frame_unshare (struct frame *f, struct page *page) {
+	list_remove(&page->frame_elem);
+	if (--f->map_cnt == 0) {
+		f->page = NULL;
+		f->owner = NULL;
+		return true;
+	}
+	if (f->page == page) {
+		struct page *heir = list_entry(list_front(&f->sharers),
+				struct page, frame_elem);
+		f->page = heir;
+		f->owner = heir->owner;
+	}
+	return false;
+}
+
+/* Detaches PAGE from its frame, if it has one, and frees the frame
+ * when no other page shares it.  Called when PAGE is destroyed. */
+void
+vm_release_frame (struct page *page) {
+	struct frame *frame;
+	bool unused;
+
+	// evict_lock을 잡아 이 페이지가 스왑 아웃되는 중이 아님을 보장한다.
+	lock_acquire(&evict_lock);
+	frame = page->frame;
+	if (frame == NULL) {
+		lock_release(&evict_lock);
+		return;
+	}
+	page->frame = NULL;
+	pml4_clear_page(thread_current()->pml4, page->va);
+
+	lock_acquire(&frame_lock);
+	// fork로 공유 중인 프레임은 마지막 페이지가 떠날 때 해제한다.
+	unused = frame_unshare(frame, page);
+	lock_release(&frame_lock);
+	lock_release(&evict_lock);
+
+	if (unused)
+		palloc_free_page(frame->kva);
 }
 
 /* Growing the stack. */
@@ -272,15 +494,34 @@ vm_stack_growth (void *addr UNUSED) {
 /* Handle the fault on write_protected page */
 static bool
 vm_handle_wp (struct page *page UNUSED) {
-  // 공유하고 있는 부모의 kva 저장
-  void *parent_kva = page->frame->kva;
-	//새로 물리메모리 할당
-  page->frame->kva = palloc_get_page(PAL_USER);
-	//기존 부모의 데이터 복사
-  memcpy(page->frame->kva, parent_kva, PGSIZE);
-  pml4_set_page(thread_current()->pml4, page->va, page->frame->kva, page->writable);
-
-  return true;
+	struct thread *curr = thread_current();
+	struct frame *shared = page->frame;
+	struct frame *frame;
+
+	lock_acquire(&frame_lock);
+	// 더 이상 공유하지 않는 프레임이면 복사 없이 쓰기 권한만 준다.
+	if (shared->map_cnt == 1) {
+		shared->page = page;
+		shared->owner = curr;
+		lock_release(&frame_lock);
+		return pml4_set_page(curr->pml4, page->va, shared->kva, page->writable);
+	}
+	lock_release(&frame_lock);
+
+	// 새 프레임에 공유하던 데이터를 복사한다. 공유 중인 프레임은 쫓겨나지 않는다.
+	frame = vm_get_frame();
+	memcpy(frame->kva, shared->kva, PGSIZE);
+
+	lock_acquire(&frame_lock);
+	frame_unshare(shared, page);
+	list_push_back(&frame->sharers, &page->frame_elem);
+	frame->page = page;
+	frame->owner = curr;
+	frame->map_cnt = 1;
+	lock_release(&frame_lock);
+
+	page->frame = frame;
+	return pml4_set_page(curr->pml4, page->va, frame->kva, page->writable);
 }
 
 /* Return true on success */
@@ -310,6 +551,15 @@ printf("PF Stat:: usr: %d, wr: %d, np: %d, addr: %lld, rsp: %lld, f-rsp: %lld \n
 	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
 	struct page *page = spt_find_page(spt, pg_round_down(addr));
 	uint64_t rsp = user ? f->rsp : thread_current()->rsp;
+	// 스왑 아웃 중인 페이지라면 끝날 때까지 기다린다.
+	// 스왑 공간이 없어 쫓겨나지 못했다면 프레임과 매핑이 되살아나 있으니
+	// 새 프레임을 받지 말고 그대로 다시 접근하게 한다.
+	if (not_present && page != NULL && page->frame != NULL) {
+		lock_acquire(&evict_lock);
+		lock_release(&evict_lock);
+		if (page->frame != NULL)
+			return true;
+	}
 	// 유저 모드일 경우 Intr_frame의 rsp를 가리켜야 한다.
 	// 해당 주소에 실제 매핑된 물리 프레임이 존재하지 않을 경우 이면서,
 	// page가 존재하지 않는다. 해당 주소가 lazy load 대기중이 아닌 처음 할당된 페이지 일경우
@@ -345,7 +595,7 @@ done:
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	kmem_cache_free (page_cache, page);
 }
 
 /* Claim the page that allocate on VA. */
@@ -363,118 +613,126 @@ vm_claim_page (void *va UNUSED) {
 /* 그리고 page에 frame을 매핑해준다. */
 static bool
 vm_do_claim_page (struct page *page) {
+	struct thread *curr = thread_current();
 	struct frame *frame = vm_get_frame ();
 	if (frame == NULL) return false;
 	/* Set links */
-	frame->page = page;
+	frame->owner = curr;
+	frame->map_cnt = 1;
 	page->frame = frame;
-	
-	// lock_acquire(&frame_lock);
-    list_push_back (&frame_table, &frame->f_elem);
-	// lock_release(&frame_lock);
+	list_push_back(&frame->sharers, &page->frame_elem);
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	struct thread *curr = thread_current();
-    bool success = pml4_set_page (curr->pml4, page->va, frame->kva, page->writable);
-
-    return success ? swap_in(page, frame->kva) : false;
-}
+	if (!pml4_set_page (curr->pml4, page->va, frame->kva, page->writable)
+			|| !swap_in(page, frame->kva))
+		return false;
 
-/* Initialize new supplemental page table */
-void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
-	hash_init(&spt->hash_brown, hash_hash_func_impl, hash_less_func_impl, NULL);
+	// 내용을 다 읽은 뒤에야 CLOCK이 이 프레임을 고를 수 있게 한다.
+	lock_acquire(&frame_lock);
+	frame->page = page;
+	lock_release(&frame_lock);
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 // fork 시에 페이지 전체 복사하기 위한 함수
+// spt src를 주소 순서대로 순회하면서 페이지마다 copy_page()로 복사한다.
+// 복사하는 동안 evict_lock을 잡아 부모의 프레임이 쫓겨나지 않게 한다.
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		struct supplemental_page_table *src UNUSED) {
+	bool success;
 
-	// TODO: src부터 dst까지 spt를 복사
-	struct hash_iterator h_iter;
-    hash_first(&h_iter, &src->hash_brown);
-	// spt src 순회하면서 다 끄집어내서 
-	// uninit인 경우에 memcpy로 복사해서 spt dst 안에 다 넣어줌
-	// file 인 경우에는 같은 파일을 바라보게 초기화 까지 해서 넣어줌
-	// 다 끝나면 가상 페이지 할당해주고 물리 프레임 붙여주고 spt에 넣어줌
-    while (hash_next(&h_iter)) {
-        // hash_cur: 현재 elem을 리턴하거나, table의 끝인 null 포인터를 반환하거나
-        struct page *src_page = hash_entry(hash_cur(&h_iter), struct page, h_elem);
-
-        enum vm_type type = src_page->operations->type;
-        void *upage = src_page->va;
-        bool writable = src_page->writable;
-
-        // 
-        if (VM_TYPE(type) == VM_UNINIT) {
-			struct lazy_load_info * temp_info = malloc( sizeof(struct lazy_load_info) );
-			memcpy ( temp_info , ((struct lazy_load_info*) src_page->uninit.aux), sizeof(struct lazy_load_info));
-			
-			if (!vm_alloc_page_with_initializer (page_get_type(src_page), upage, src_page->writable,
-				 src_page->uninit.init, (void *)temp_info)) {
-					return false;
-			}
-        }
-		// 이 분기를 타는 페이지들은 전부 fork된 file_page를 부모로 가진 
-		// 생성될 uninit page들 뿐이다. 
-		else if (VM_TYPE(type) == VM_FILE) { 
-			struct lazy_load_info *info = malloc(sizeof(struct lazy_load_info));
-			info->file = src_page->file.file;
-			info->ofs = src_page->file.offset;
-			info->read_bytes = src_page->file.read_bytes;
-			info->zero_bytes = src_page->file.zero_bytes;
-			// 자식 만들기
-			if (!vm_alloc_page_with_initializer(type, upage, writable, NULL, info))
+	lock_acquire(&evict_lock);
+	success = spt_walk_range(src, NULL, (void *) KERN_BASE, copy_page, dst);
+	lock_release(&evict_lock);
+	return success;
+}
+
+/* Copies SRC_PAGE of the parent into DST, the child's spt.  A page in
+ * a frame shares it with the child until either writes; a file page
+ * out of memory is left for the child to read back from the file, and
+ * an anonymous page out of memory gets a frame of its own holding a
+ * copy of the swapped-out contents.  Called with evict_lock held.
+ * Returns false on failure. */
+// uninit인 경우에 memcpy로 복사해서 spt dst 안에 다 넣어줌
+// file 인 경우에는 같은 파일을 바라보게 초기화 까지 해서 넣어줌
+// 다 끝나면 가상 페이지 할당해주고 물리 프레임 붙여주고 spt에 넣어줌
+static bool
+copy_page (struct page *src_page, void *dst_) {
+	struct supplemental_page_table *dst = dst_;
+
+	enum vm_type type = src_page->operations->type;
+	void *upage = src_page->va;
+	bool writable = src_page->writable;
+
+	// 
+	if (VM_TYPE(type) == VM_UNINIT) {
+		struct lazy_load_info * temp_info = malloc( sizeof(struct lazy_load_info) );
+		memcpy ( temp_info , ((struct lazy_load_info*) src_page->uninit.aux), sizeof(struct lazy_load_info));
+		
+		if (!vm_alloc_page_with_initializer (page_get_type(src_page), upage, src_page->writable,
+			 src_page->uninit.init, (void *)temp_info)) {
 				return false;
-			// 진로 강요
-			struct page *dst_file_page = spt_find_page(dst, upage);
-			file_backed_initializer(dst_file_page, type, NULL);
-			dst_file_page->frame = src_page->frame;
-			pml4_set_page(thread_current()->pml4, dst_file_page->va, src_page->frame->kva, src_page->writable);
-			continue;
 		}
-		else {
-			if (!vm_alloc_page(page_get_type(src_page), src_page->va, src_page->writable)) 
-				return false;
-			// 주석친 코드들은 Copy on write가 적용 되기 이전의 코드들이며 이것도 매우 잘 동작한다.
-			// 지우지 말았으면 좋겠다.
-			// if (!vm_claim_page(src_page->va))
-			// 	return false;
-			
-			// 매핑된 프레임에 내용 로딩
-			struct page *dst_page = spt_find_page(dst, upage);
-			// memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
-
-			// cow 하려고 만든 부분
-			struct frame *cpy_frame = malloc(sizeof(struct frame));
-			dst_page->frame = cpy_frame;
-			cpy_frame->page = dst_page;
-			// 자식 frame 구조체를 만들고 물리메모리의 시작 주소 kva를 부모와 같은 곳을 가리키도록 할당한다.
-      		cpy_frame->kva = src_page->frame->kva;
-			lock_acquire(&frame_lock);
-			list_push_back(&frame_table, &cpy_frame->f_elem);
-			lock_release(&frame_lock);
-			// 자식의 page에 대한 pml4 맵핑 시 writable 0으로 만들어준다.
-			if (pml4_set_page(thread_current()->pml4, dst_page->va, cpy_frame->kva, 0) == false)
-			{
+	}
+	// 이 분기를 타는 페이지들은 전부 fork된 file_page를 부모로 가진 
+	// 생성될 uninit page들 뿐이다. 
+	else if (VM_TYPE(type) == VM_FILE) { 
+		struct lazy_load_info *info = malloc(sizeof(struct lazy_load_info));
+		info->file = src_page->file.file;
+		info->ofs = src_page->file.offset;
+		info->read_bytes = src_page->file.read_bytes;
+		info->zero_bytes = src_page->file.zero_bytes;
+		// 자식 만들기
+		if (!vm_alloc_page_with_initializer(type, upage, writable, NULL, info))
+			return false;
+		// 진로 강요
+		struct page *dst_file_page = spt_find_page(dst, upage);
+		file_backed_initializer(dst_file_page, type, NULL);
+		// 부모가 파일에 되써 두었으면 자식도 폴트 때 파일에서 읽는다.
+		if (src_page->frame == NULL)
+			return true;
+		dst_file_page->frame = src_page->frame;
+		frame_share(src_page->frame, dst_file_page);
+		pml4_set_page(thread_current()->pml4, dst_file_page->va, src_page->frame->kva, src_page->writable);
+		return true;
+	}
+	else {
+		if (!vm_alloc_page(page_get_type(src_page), src_page->va, src_page->writable)) 
+			return false;
+		// 주석친 코드들은 Copy on write가 적용 되기 이전의 코드들이며 이것도 매우 잘 동작한다.
+		// 지우지 말았으면 좋겠다.
+		// if (!vm_claim_page(src_page->va))
+		// 	return false;
+		
+		// 매핑된 프레임에 내용 로딩
+		struct page *dst_page = spt_find_page(dst, upage);
+		// memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
+
+		// 스왑 아웃된 페이지는 공유할 프레임이 없으니 자식에게 사본을 읽어 준다.
+		// evict_lock을 잡고 있어 읽는 동안 새 프레임이 쫓겨나지 않는다.
+		if (src_page->frame == NULL) {
+			if (!vm_do_claim_page(dst_page))
 				return false;
-			}
-			swap_in(dst_page, cpy_frame->kva);
-
+			anon_copy_swapped(src_page, dst_page->frame->kva);
+			return true;
 		}
-    }
-    return true;
 
-}
+		// cow 하려고 만든 부분
+		// 자식 page도 부모와 같은 프레임을 가리키게 하고 공유 수를 늘린다.
+		struct frame *shared = src_page->frame;
+		dst_page->frame = shared;
+		frame_share(shared, dst_page);
+		// 자식의 page에 대한 pml4 맵핑 시 writable 0으로 만들어준다.
+		if (pml4_set_page(thread_current()->pml4, dst_page->va, shared->kva, 0) == false)
+		{
+			return false;
+		}
+		swap_in(dst_page, shared->kva);
 
-/* Free the resource hold by the supplemental page table */
-void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
-	hash_clear(&spt->hash_brown, hash_action_func_impl);
+	}
+	return true;
 }
 
 /* Project 3 */
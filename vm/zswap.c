@@ -0,0 +1,404 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+ *
+ * An anonymous page that is evicted is first compressed into a pool of
+ * kernel pages.  It goes to the swap disk only when the pool is full or
+ * the page does not compress well, and swapping it back in from the
+ * pool costs a decompression instead of a disk read.  Zero-filled
+ * pages take no pool space at all. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+bool zswap_enabled;
+size_t zswap_max_pages;
+struct zswap_stats zswap_stats;
+
+/* Pool pages are managed as in zbud: each holds at most two compressed
+ * pages, the "first" packed against the header at the start of the
+ * page and the "last" packed against its end.  Space is counted in
+ * chunks of ZBUD_CHUNK bytes.  A page with one buddy free sits on the
+ * unbuddied list for its number of free chunks, so a store finds the
+ * tightest page that fits without a search. */
+#define ZBUD_CHUNK 64
+#define ZBUD_CHUNKS (PGSIZE / ZBUD_CHUNK)
+#define ZBUD_FREE_CHUNKS (ZBUD_CHUNKS - 1)  /* Less the header chunk. */
+
+/* Largest compressed page stored, so that each pool page holds two. */
+#define ZSWAP_MAX_SIZE (ZBUD_FREE_CHUNKS / 2 * ZBUD_CHUNK)
+
+/* Default pool size, as a fraction of the user frames. */
+#define ZSWAP_DEFAULT_DIV 8
+
+/* Header at the start of each pool page. */
+struct zbud_header {
+	struct list_elem elem;      /* Element in an unbuddied list. */
+	uint16_t first_size;        /* Bytes in the first buddy, 0 if free. */
+	uint16_t last_size;         /* Bytes in the last buddy, 0 if free. */
+};
+
+/* A handle is the address of the pool page, with ZSWAP_LAST set for
+ * the last buddy.  ZSWAP_ZERO stands for a zero-filled page. */
+#define ZSWAP_LAST 1
+#define ZSWAP_ZERO 2
+
+#define handle_header(H) ((struct zbud_header *) ((H) & ~(uint64_t) PGMASK))
+
+static struct lock zswap_lock;  /* Protects the pool and the members below. */
+static struct list unbuddied[ZBUD_FREE_CHUNKS + 1];
+static size_t pool_pages;       /* Pages in the pool. */
+static size_t stored_pages;     /* Compressed pages in the pool. */
+
+/* Compression buffer, and the match table of the compressor. */
+static uint8_t zswap_buf[ZSWAP_MAX_SIZE];
+#define LZ_HASH_BITS 10
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t cap);
+static void lz_decompress (const uint8_t *src, size_t size, uint8_t *dst);
+static uint64_t zbud_alloc (size_t size);
+static void zbud_free (uint64_t handle);
+static void *zbud_map (uint64_t handle);
+static size_t zbud_size (uint64_t handle);
+
+/* Initializes the compressed pool. */
+void
+zswap_init (void) {
+	size_t i;
+
+	lock_init (&zswap_lock);
+	for (i = 0; i <= ZBUD_FREE_CHUNKS; i++)
+		list_init (&unbuddied[i]);
+	if (zswap_max_pages == 0) {
+		zswap_max_pages = palloc_user_page_cnt () / ZSWAP_DEFAULT_DIV;
+		if (zswap_max_pages == 0)
+			zswap_max_pages = 1;
+	}
+}
+
+/* Returns true if the page at KVA holds only zeros. */
+static bool
+is_zero_page (const void *kva) {
+	const uint64_t *p = kva;
+	size_t i;
+
+	for (i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
+	return true;
+}
+
+/* Compresses the page at KVA into the pool and stores its handle in
+ * *HANDLE, which is never 0.  Returns false, storing nothing, if zswap
+ * is disabled, the page does not compress to ZSWAP_MAX_SIZE bytes, or
+ * the pool is full. */
+bool
+zswap_store (const void *kva, uint64_t *handle) {
+	size_t size;
+	uint64_t h;
+
+	if (!zswap_enabled)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	if (is_zero_page (kva)) {
+		zswap_stats.stores++;
+		zswap_stats.zero_stores++;
+		lock_release (&zswap_lock);
+		*handle = ZSWAP_ZERO;
+		return true;
+	}
+
+	size = lz_compress (kva, zswap_buf, sizeof zswap_buf);
+	if (size == 0) {
+		zswap_stats.rejects_poor++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+	h = zbud_alloc (size);
+	if (h == 0) {
+		zswap_stats.rejects_full++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+	memcpy (zbud_map (h), zswap_buf, size);
+	stored_pages++;
+	zswap_stats.stores++;
+	zswap_stats.stored_bytes += size;
+	lock_release (&zswap_lock);
+
+	*handle = h;
+	return true;
+}
+
+/* Decompresses the page with HANDLE into the page at KVA, and removes
+ * it from the pool. */
+void
+zswap_load (uint64_t handle, void *kva) {
+	ASSERT (handle != 0);
+
+	lock_acquire (&zswap_lock);
+	zswap_stats.hits++;
+	if (handle == ZSWAP_ZERO) {
+		lock_release (&zswap_lock);
+		memset (kva, 0, PGSIZE);
+		return;
+	}
+	lz_decompress (zbud_map (handle), zbud_size (handle), kva);
+	zbud_free (handle);
+	stored_pages--;
+	lock_release (&zswap_lock);
+}
+
+/* Decompresses the page with HANDLE into the page at KVA, and leaves
+ * it in the pool. */
+void
+zswap_peek (uint64_t handle, void *kva) {
+	ASSERT (handle != 0);
+
+	if (handle == ZSWAP_ZERO) {
+		memset (kva, 0, PGSIZE);
+		return;
+	}
+	lock_acquire (&zswap_lock);
+	lz_decompress (zbud_map (handle), zbud_size (handle), kva);
+	lock_release (&zswap_lock);
+}
+
+/* Removes the page with HANDLE from the pool without reading it. */
+void
+zswap_free (uint64_t handle) {
+	ASSERT (handle != 0);
+
+	if (handle == ZSWAP_ZERO)
+		return;
+	lock_acquire (&zswap_lock);
+	zbud_free (handle);
+	stored_pages--;
+	lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap statistics. */
+void
+zswap_print_stats (void) {
+	long long pool_stores = zswap_stats.stores - zswap_stats.zero_stores;
+	long long ratio = zswap_stats.stored_bytes != 0
+		? pool_stores * PGSIZE * 100 / zswap_stats.stored_bytes : 0;
+
+	if (!zswap_enabled)
+		return;
+	printf ("zswap: %lld stores (%lld zero), %lld hits, ratio %lld.%02lld, "
+			"%zu pages in %zu of %zu pool pages\n",
+			zswap_stats.stores, zswap_stats.zero_stores, zswap_stats.hits,
+			ratio / 100, ratio % 100, stored_pages, pool_pages,
+			zswap_max_pages);
+	printf ("zswap: %lld rejected by a full pool, %lld incompressible, "
+			"%lld written to disk\n",
+			zswap_stats.rejects_full, zswap_stats.rejects_poor,
+			zswap_stats.writebacks);
+}
+
+/* LZ77 compression of one page.  The output is a sequence of items,
+ * each starting with a control byte C:
+ *
+ *   - C < 0x80: C + 1 literal bytes follow.
+ *
+ *   - C >= 0x80: a match of (C & 0x7f) + LZ_MIN_MATCH bytes, to be
+ *     copied from the distance back in the output given by the next
+ *     two bytes, in little-endian order.
+ *
+ * Matches are found as in LZ4, through a table of the last position
+ * of each hashed 4-byte sequence: one probe per position, no chains. */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t
+load32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Appends the CNT literal bytes at SRC to the CAP-byte buffer DST, in
+ * which *OUT bytes are used.  Returns false if they do not fit. */
+static bool
+lz_literals (const uint8_t *src, size_t cnt, uint8_t *dst, size_t *out,
+		size_t cap) {
+	while (cnt > 0) {
+		size_t n = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+
+		if (*out + 1 + n > cap)
+			return false;
+		dst[(*out)++] = n - 1;
+		memcpy (dst + *out, src, n);
+		*out += n;
+		src += n;
+		cnt -= n;
+	}
+	return true;
+}
+
+/* Compresses the page at SRC into DST, which has room for CAP bytes.
+ * Returns the compressed size, or 0 if it would exceed CAP. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap) {
+	size_t pos = 0, lit = 0, out = 0;
+
+	memset (lz_table, 0, sizeof lz_table);
+	while (pos + LZ_MIN_MATCH <= PGSIZE) {
+		uint32_t seq = load32 (src + pos);
+		size_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t cand = lz_table[h];
+		size_t len, dist;
+
+		lz_table[h] = pos;
+		if (cand >= pos || load32 (src + cand) != seq) {
+			pos++;
+			continue;
+		}
+
+		len = LZ_MIN_MATCH;
+		while (len < LZ_MAX_MATCH && pos + len < PGSIZE
+				&& src[cand + len] == src[pos + len])
+			len++;
+		if (!lz_literals (src + lit, pos - lit, dst, &out, cap)
+				|| out + 3 > cap)
+			return 0;
+		dist = pos - cand;
+		dst[out++] = 0x80 | (len - LZ_MIN_MATCH);
+		dst[out++] = dist & 0xff;
+		dst[out++] = dist >> 8;
+		pos += len;
+		lit = pos;
+	}
+	if (!lz_literals (src + lit, PGSIZE - lit, dst, &out, cap))
+		return 0;
+	return out;
+}
+
+/* Decompresses the SIZE bytes at SRC, produced by lz_compress(), into
+ * the page at DST. */
+static void
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst) {
+	size_t in = 0, out = 0;
+
+	while (in < size) {
+		uint8_t c = src[in++];
+
+		if (c < LZ_MAX_LITERALS) {
+			size_t n = c + 1;
+			memcpy (dst + out, src + in, n);
+			in += n;
+			out += n;
+		} else {
+			size_t len = (c & 0x7f) + LZ_MIN_MATCH;
+			size_t dist = src[in] | (src[in + 1] << 8);
+			size_t i;
+
+			in += 2;
+			/* The source may overlap what is being written. */
+			for (i = 0; i < len; i++)
+				dst[out + i] = dst[out - dist + i];
+			out += len;
+		}
+	}
+	ASSERT (out == PGSIZE);
+}
+
+/* Returns the number of chunks SIZE bytes take. */
+static inline size_t
+size_chunks (size_t size) {
+	return DIV_ROUND_UP (size, ZBUD_CHUNK);
+}
+
+/* Returns the number of free chunks of pool page Z, which has one
+ * buddy in use. */
+static size_t
+zbud_free_chunks (const struct zbud_header *z) {
+	return ZBUD_FREE_CHUNKS - size_chunks (z->first_size)
+		- size_chunks (z->last_size);
+}
+
+/* Allocates SIZE bytes in the pool and returns their handle, or 0 if
+ * the pool is full. */
+static uint64_t
+zbud_alloc (size_t size) {
+	size_t chunks = size_chunks (size);
+	struct zbud_header *z = NULL;
+	size_t i;
+
+	ASSERT (size > 0 && size <= ZSWAP_MAX_SIZE);
+
+	for (i = chunks; i <= ZBUD_FREE_CHUNKS; i++)
+		if (!list_empty (&unbuddied[i])) {
+			z = list_entry (list_pop_front (&unbuddied[i]),
+					struct zbud_header, elem);
+			break;
+		}
+
+	if (z == NULL) {
+		if (pool_pages >= zswap_max_pages)
+			return 0;
+		z = palloc_get_page (0);
+		if (z == NULL)
+			return 0;
+		pool_pages++;
+		z->first_size = z->last_size = 0;
+	}
+
+	if (z->first_size == 0) {
+		z->first_size = size;
+		if (z->last_size == 0)
+			list_push_front (&unbuddied[zbud_free_chunks (z)], &z->elem);
+		return (uint64_t) z;
+	}
+	z->last_size = size;
+	return (uint64_t) z | ZSWAP_LAST;
+}
+
+/* Frees the pool space of HANDLE, and its page once both buddies are
+ * free. */
+static void
+zbud_free (uint64_t handle) {
+	struct zbud_header *z = handle_header (handle);
+
+	/* A page with only one buddy in use is on an unbuddied list. */
+	if (z->first_size == 0 || z->last_size == 0)
+		list_remove (&z->elem);
+	if (handle & ZSWAP_LAST)
+		z->last_size = 0;
+	else
+		z->first_size = 0;
+
+	if (z->first_size == 0 && z->last_size == 0) {
+		palloc_free_page (z);
+		pool_pages--;
+	} else
+		list_push_front (&unbuddied[zbud_free_chunks (z)], &z->elem);
+}
+
+/* Returns the address of the data of HANDLE. */
+static void *
+zbud_map (uint64_t handle) {
+	struct zbud_header *z = handle_header (handle);
+
+	if (handle & ZSWAP_LAST)
+		return (uint8_t *) z + PGSIZE - size_chunks (z->last_size) * ZBUD_CHUNK;
+	return (uint8_t *) z + ZBUD_CHUNK;
+}
+
+/* Returns the size of the data of HANDLE. */
+static size_t
+zbud_size (uint64_t handle) {
+	struct zbud_header *z = handle_header (handle);
+
+	return handle & ZSWAP_LAST ? z->last_size : z->first_size;
+}